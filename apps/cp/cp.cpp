@@ -1,4 +1,7 @@
 #include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include "../syscall.h"
 
 int main(int argc, char** argv) {
   if (argc < 3) {
@@ -6,26 +9,28 @@ int main(int argc, char** argv) {
     return 1;
   }
 
-  FILE* fp_src = fopen(argv[1], "r");
-  if (fp_src == nullptr) {
+  auto [fd_src, err_src] = SyscallOpenFile(argv[1], O_RDONLY);
+  if (err_src) {
     printf("failed to open for read: %s\n", argv[1]);
     return 1;
   }
 
-  FILE* fp_dest = fopen(argv[2], "w");
-  if (fp_dest == nullptr) {
+  auto [fd_dest, err_dest] = SyscallOpenFile(argv[2], O_WRONLY | O_CREAT);
+  if (err_dest) {
     printf("failed to open for write: %s\n", argv[2]);
     return 1;
   }
 
-  char buf[256];
-  size_t bytes;
-  while ((bytes = fread(buf, 1, sizeof(buf), fp_src)) > 0) {
-    const size_t written = fwrite(buf, 1, bytes, fp_dest);
-    if (bytes != written) {
-      printf("failed to write to %s\n", argv[2]);
+  // 中身はカーネル内でクラスタ単位に直接コピーされる
+  while (true) {
+    auto [bytes, err] = SyscallSplice(fd_src, fd_dest, 1024 * 1024);
+    if (err) {
+      printf("failed to copy to %s: %s\n", argv[2], strerror(err));
       return 1;
     }
+    if (bytes == 0) {
+      break;
+    }
   }
   return 0;
 }
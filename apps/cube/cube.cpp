@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include "../syscall.h"
@@ -14,8 +15,9 @@ struct Vector2D {
   T x, y;
 };
 
-void DrawObj(uint64_t layer_id);
-void DrawSurface(uint64_t layer_id, int sur);
+void DrawObj();
+void DrawSurface(int sur);
+void FillCanvasRow(int y, int x0, int x1, uint32_t c);
 bool Sleep(unsigned long ms);
 
 const int kScale = 50, kMargin = 10;
@@ -34,6 +36,7 @@ const array<uint32_t, kSurface.size()> kColor{
 array<Vector3D<double>, kCube.size()> vert;
 array<double, kSurface.size()> centerz4;
 array<Vector2D<int>, kCube.size()> scr;
+AppSurface win_surface;
 
 int main(int argc, char** argv) {
   auto [layer_id, err_openwin]
@@ -41,6 +44,10 @@ int main(int argc, char** argv) {
   if (err_openwin) {
     return err_openwin;
   }
+  if (auto err = SyscallMapWindowSurface(layer_id, &win_surface).error) {
+    return err;
+  }
+  const AppRect canvas{4, 24, kCanvasSize, kCanvasSize};
 
   int thx = 0, thy = 0, thz = 0;
   const double to_rad = 3.14159265358979323 / 0x8000;
@@ -71,10 +78,11 @@ int main(int argc, char** argv) {
     }
 
     // 画面を一旦クリアし，立方体を描画
-    SyscallWinFillRectangle(layer_id | LAYER_NO_REDRAW,
-                            4, 24, kCanvasSize, kCanvasSize, 0);
-    DrawObj(layer_id | LAYER_NO_REDRAW);
-    SyscallWinRedraw(layer_id);
+    for (int y = 0; y < kCanvasSize; ++y) {
+      FillCanvasRow(y, 0, kCanvasSize - 1, 0);
+    }
+    DrawObj();
+    SyscallWinCommit(layer_id, &canvas, 1);
     if (Sleep(50)) {
       break;
     }
@@ -84,7 +92,13 @@ int main(int argc, char** argv) {
   return 0;
 }
 
-void DrawObj(uint64_t layer_id) {
+void FillCanvasRow(int y, int x0, int x1, uint32_t c) {
+  auto pixels = reinterpret_cast<uint8_t*>(win_surface.pixels);
+  auto row = reinterpret_cast<uint32_t*>(pixels + win_surface.stride * (24 + y));
+  fill(row + 4 + x0, row + 4 + x1 + 1, AppSurfaceColor(&win_surface, c));
+}
+
+void DrawObj() {
   // オブジェクト座標 vert を スクリーン座標 scr に変換（画面奥が Z+）
   for (int i = 0; i < kCube.size(); i++) {
     const double t = 6*kScale / (vert[i].z + 8*kScale);
@@ -108,12 +122,12 @@ void DrawObj(uint64_t layer_id) {
     const auto e0x = v1.x - v0.x, e0y = v1.y - v0.y, // v0 --> v1
                e1x = v2.x - v1.x, e1y = v2.y - v1.y; // v1 --> v2
     if (e0x * e1y <= e0y * e1x) {
-      DrawSurface(layer_id, sur);
+      DrawSurface(sur);
     }
   }
 }
 
-void DrawSurface(uint64_t layer_id, int sur) {
+void DrawSurface(int sur) {
   const auto& surface = kSurface[sur]; // 描画する面
   int ymin = kCanvasSize, ymax = 0; // 画面の描画範囲 [ymin, ymax]
   int y2x_up[kCanvasSize], y2x_down[kCanvasSize]; // Y, X 座標の組
@@ -146,7 +160,7 @@ void DrawSurface(uint64_t layer_id, int sur) {
   for (int y = ymin; y <= ymax; y++) {
     int p0x = min(y2x_up[y], y2x_down[y]);
     int p1x = max(y2x_up[y], y2x_down[y]);
-    SyscallWinFillRectangle(layer_id, 4 + p0x, 24 + y, p1x - p0x + 1, 1, kColor[sur]);
+    FillCanvasRow(y, p0x, p1x, kColor[sur]);
   }
 }
 
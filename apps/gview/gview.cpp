@@ -42,15 +42,13 @@ void WaitEvent() {
   }
 }
 
-uint32_t GetColorRGB(unsigned char* image_data) {
-  return static_cast<uint32_t>(image_data[0]) << 16 |
-         static_cast<uint32_t>(image_data[1]) << 8 |
-         static_cast<uint32_t>(image_data[2]);
-}
-
-uint32_t GetColorGray(unsigned char* image_data) {
-  const uint32_t gray = image_data[0];
-  return gray << 16 | gray << 8 | gray;
+AppPixelFormat GetPixelFormat(int bytes_per_pixel) {
+  switch (bytes_per_pixel) {
+  case 1: return kAppPixelGray8;
+  case 2: return kAppPixelGrayA88;
+  case 3: return kAppPixelRGB888;
+  default: return kAppPixelRGBA8888;
+  }
 }
 
 int main(int argc, char** argv) {
@@ -71,10 +69,6 @@ int main(int argc, char** argv) {
   }
 
   fprintf(stderr, "%dx%d, %d bytes/pixel\n", width, height, bytes_per_pixel);
-  auto get_color = GetColorRGB;
-  if (bytes_per_pixel <= 2) {
-    get_color = GetColorGray;
-  }
 
   const char* last_slash = strrchr(filepath, '/');
   const char* filename = last_slash ? &last_slash[1] : filepath;
@@ -86,15 +80,10 @@ int main(int argc, char** argv) {
   }
   const uint64_t layer_id = window.value;
 
-  for (int y = 0; y < height; ++y) {
-    for (int x = 0; x < width; ++x) {
-      uint32_t c = get_color(&image_data[bytes_per_pixel * (y * width + x)]);
-      SyscallWinFillRectangle(layer_id | LAYER_NO_REDRAW,
-                              4 + x, 24 + y, 1, 1, c);
-    }
-  }
-
-  SyscallWinRedraw(layer_id);
+  const AppPixelBuffer image{
+    image_data, width, height, bytes_per_pixel * width,
+    GetPixelFormat(bytes_per_pixel)};
+  SyscallWinBlit(layer_id, 4, 24, &image);
   WaitEvent();
 
   SyscallCloseWindow(layer_id);
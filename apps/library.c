@@ -5,3 +5,8 @@ extern int main(int, char**);
 void _start(int argc, char** argv) {
   SyscallExit(main(argc, argv));
 }
+
+void ThreadEntry(uint64_t func, uint64_t arg) {
+  int (*f)(void*) = (int (*)(void*))func;
+  SyscallExit(f((void*)arg));
+}
@@ -2,6 +2,7 @@
 #include <array>
 #include <complex>
 #include <cstdio>
+#include <cstdlib>
 
 #include "../syscall.h"
 
@@ -116,27 +117,71 @@ void WaitEvent() {
 }
 
 constexpr int kWidth = 78*4, kHeight = 52*4;
+constexpr int kMaxThreads = 8;
+
+// xmin: 実部の最小値, ymin: 虚部の最小値
+constexpr double kXMin  = -2.3,   kYMin  = -1.3;
+constexpr double kXStep = 0.0125, kYStep = 0.0125;
+
+std::array<std::array<int, kWidth>, kHeight> depths;
+
+struct Band {
+  int first_row, row_step;
+};
+
+// 担当する行（first_row から row_step 行おき）の depth を計算する
+int CalcBand(void* arg) {
+  const auto band = reinterpret_cast<Band*>(arg);
+  for (int y = band->first_row; y < kHeight; y += band->row_step) {
+    for (int x = 0; x < kWidth; ++x) {
+      // 漸化式の計算が収束するまでの再帰回数 depth (100 を上限とする) を得る
+      depths[y][x] = MandelConverge({kXMin + kXStep*x, kYMin + kYStep*y});
+    }
+  }
+  return 0;
+}
 
 int main(int argc, char** argv) {
+  int num_threads = 1;
+  if (argc >= 2) {
+    num_threads = std::clamp(atoi(argv[1]), 1, kMaxThreads);
+  }
+
   auto [layer_id, err_openwin]
     = SyscallOpenWindow(kWidth + 8, kHeight + 28, 10, 10, "mandel");
   if (err_openwin) {
     return err_openwin;
   }
 
-  // xmin: 実部の最小値, ymin: 虚部の最小値
-  const double xmin  = -2.3,   ymin  = -1.3;
-  const double xstep = 0.0125, ystep = 0.0125;
+  std::array<Band, kMaxThreads> bands;
+  std::array<uint64_t, kMaxThreads> thread_ids{};
+  for (int i = 0; i < num_threads; ++i) {
+    bands[i] = {i, num_threads};
+  }
+  for (int i = 1; i < num_threads; ++i) {
+    auto [ id, err ] = SyscallCreateThread(
+        ThreadEntry, reinterpret_cast<uint64_t>(CalcBand),
+        reinterpret_cast<uint64_t>(&bands[i]), 0);
+    if (err) {
+      fprintf(stderr, "CreateThread failed: %s\n", strerror(err));
+      CalcBand(&bands[i]);
+    } else {
+      thread_ids[i] = id;
+    }
+  }
+  CalcBand(&bands[0]);
+  for (int i = 1; i < num_threads; ++i) {
+    if (thread_ids[i]) {
+      SyscallJoinThread(thread_ids[i]);
+    }
+  }
 
   for (int y = 0; y < kHeight; ++y) {
     for (int x = 0; x < kWidth; ++x) {
-      // 漸化式の計算が収束するまでの再帰回数 depth (100 を上限とする) を得る
-      int depth = MandelConverge({xmin + xstep*x, ymin + ystep*y});
-
       SyscallWinFillRectangle(
         layer_id | LAYER_NO_REDRAW,
         4+x, 24+y, 1, 1,
-        WaveLenToColor(depth * 4 + kWaveLenMin)
+        WaveLenToColor(depths[y][x] * 4 + kWaveLenMin)
       );
     }
   }
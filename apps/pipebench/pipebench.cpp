@@ -0,0 +1,63 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "../syscall.h"
+
+// pipebench [MiB] | pipebench
+// 標準入力が端末なら指定量のデータを書き出し，パイプなら読み切るまでの速さを表示する
+static char buf[64 * 1024];
+
+int Produce(unsigned long bytes) {
+  memset(buf, 'x', sizeof(buf));
+  while (bytes > 0) {
+    const size_t n = bytes < sizeof(buf) ? bytes : sizeof(buf);
+    auto [written, err] = SyscallPutString(1, buf, n);
+    if (err || written == 0) {
+      return 1;
+    }
+    bytes -= written;
+  }
+  return 0;
+}
+
+int Consume() {
+  unsigned long total = 0;
+  auto [tick_start, timer_freq] = SyscallGetCurrentTick();
+  while (true) {
+    auto [n, err] = SyscallReadFile(0, buf, sizeof(buf));
+    if (err) {
+      fprintf(stderr, "read error: %s\n", strerror(err));
+      return 1;
+    }
+    if (n == 0) {
+      break;
+    }
+    total += n;
+  }
+  auto tick_end = SyscallGetCurrentTick().value;
+
+  const unsigned long ms = (tick_end - tick_start) * 1000 / timer_freq;
+  if (ms == 0) {
+    printf("%lu bytes in < %lu ms\n", total, 1000 / timer_freq);
+  } else {
+    printf("%lu bytes in %lu ms (%lu KiB/s)\n",
+           total, ms, total / 1024 * 1000 / ms);
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (!SyscallIsTerminal(0).value) {
+    return Consume();
+  }
+
+  unsigned long mib = 16;
+  if (argc >= 2) {
+    mib = atoi(argv[1]);
+  }
+  if (SyscallIsTerminal(1).value) {
+    printf("Usage: %s [MiB] | %s\n", argv[0], argv[0]);
+    return 1;
+  }
+  return Produce(mib * 1024 * 1024);
+}
@@ -0,0 +1,81 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "../syscall.h"
+
+static constexpr int kWidth = 200, kHeight = 100;
+
+SyscallRing ring;
+
+// SQ に 1 要求積む。SQ が満杯なら先に SubmitRing で捌き，CQ を読み捨てる
+void Enqueue(uint32_t opcode, uint64_t a0, uint64_t a1, uint64_t a2,
+             uint64_t a3, uint64_t a4, uint64_t a5) {
+  if (ring.sq_tail - ring.sq_head == SYSCALL_RING_SIZE) {
+    SyscallSubmitRing(&ring);
+    ring.cq_head = ring.cq_tail;
+  }
+  auto& sqe = ring.sq[ring.sq_tail % SYSCALL_RING_SIZE];
+  sqe.opcode = opcode;
+  sqe.user_data = ring.sq_tail;
+  sqe.args[0] = a0; sqe.args[1] = a1; sqe.args[2] = a2;
+  sqe.args[3] = a3; sqe.args[4] = a4; sqe.args[5] = a5;
+  ++ring.sq_tail;
+}
+
+void Flush() {
+  while (ring.sq_head != ring.sq_tail) {
+    SyscallSubmitRing(&ring);
+    ring.cq_head = ring.cq_tail;
+  }
+}
+
+uint32_t PixelColor(int i) {
+  return (i * 0x010307) & 0xffffff;
+}
+
+void PrintResult(const char* name, int num_ops, unsigned long ticks,
+                 unsigned long timer_freq) {
+  const unsigned long ms = ticks * 1000 / timer_freq;
+  if (ms == 0) {
+    printf("%-8s %d ops in < %lu ms\n", name, num_ops, 1000 / timer_freq);
+    return;
+  }
+  printf("%-8s %d ops in %lu ms (%lu ops/s)\n",
+         name, num_ops, ms, num_ops * 1000ul / ms);
+}
+
+int main(int argc, char** argv) {
+  int num_ops = 100000;
+  if (argc >= 2) {
+    num_ops = atoi(argv[1]);
+  }
+
+  auto [layer_id, err_openwin]
+    = SyscallOpenWindow(kWidth + 8, kHeight + 28, 10, 10, "ringbench");
+  if (err_openwin) {
+    return err_openwin;
+  }
+
+  auto [tick_start, timer_freq] = SyscallGetCurrentTick();
+  for (int i = 0; i < num_ops; ++i) {
+    SyscallWinFillRectangle(layer_id | LAYER_NO_REDRAW,
+                            4 + i % kWidth, 24 + (i / kWidth) % kHeight, 1, 1,
+                            PixelColor(i));
+  }
+  SyscallWinRedraw(layer_id);
+  auto tick_direct = SyscallGetCurrentTick().value;
+  PrintResult("direct", num_ops, tick_direct - tick_start, timer_freq);
+
+  for (int i = 0; i < num_ops; ++i) {
+    Enqueue(0x80000005, layer_id | LAYER_NO_REDRAW,
+            4 + i % kWidth, 24 + (i / kWidth) % kHeight, 1, 1,
+            PixelColor(i + 1));
+  }
+  Enqueue(0x80000007, layer_id, 0, 0, 0, 0, 0);
+  Flush();
+  auto tick_ring = SyscallGetCurrentTick().value;
+  PrintResult("ring", num_ops, tick_ring - tick_direct, timer_freq);
+
+  SyscallCloseWindow(layer_id);
+  return 0;
+}
@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <cstdio>
 #include <string>
 #include <vector>
+#include "../syscall.h"
 
 int main(int argc, char** argv) {
   FILE* fp = stdin;
@@ -30,8 +32,16 @@ int main(int argc, char** argv) {
   };
 
   std::sort(lines.begin(), lines.end(), comp);
-  for (auto& line : lines) {
-    printf("%s", line.c_str());
+
+  // 1 行ずつ printf せず，何行分もまとめて 1 回のシステムコールで書き出す
+  std::vector<AppIoVec> iov;
+  for (size_t i = 0; i < lines.size(); i += APP_IOV_MAX) {
+    const size_t n = std::min<size_t>(lines.size() - i, APP_IOV_MAX);
+    iov.clear();
+    for (size_t j = 0; j < n; ++j) {
+      iov.push_back({lines[i + j].data(), lines[i + j].length()});
+    }
+    SyscallWriteVec(1, iov.data(), n);
   }
   return 0;
 }
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <random>
 #include "../syscall.h"
 
@@ -24,8 +25,19 @@ int main(int argc, char** argv) {
     return err_openwin;
   }
 
-  SyscallWinFillRectangle(layer_id | LAYER_NO_REDRAW,
-                          4, 24, kWidth, kHeight, 0x000000);
+  AppSurface surface;
+  if (auto err = SyscallMapWindowSurface(layer_id, &surface).error) {
+    return err;
+  }
+  auto pixel_at = [&surface](int x, int y) {
+    auto pixels = reinterpret_cast<uint8_t*>(surface.pixels);
+    auto row = reinterpret_cast<uint32_t*>(pixels + surface.stride * (24 + y));
+    return row + 4 + x;
+  };
+  for (int y = 0; y < kHeight; ++y) {
+    std::fill(pixel_at(0, y), pixel_at(kWidth, y), 0);
+  }
+  const uint32_t star_color = AppSurfaceColor(&surface, 0xfff100);
 
   int num_stars = 100;
   if (argc >= 2) {
@@ -39,10 +51,11 @@ int main(int argc, char** argv) {
   for (int i = 0; i < num_stars; ++i) {
     int x = x_dist(rand_engine);
     int y = y_dist(rand_engine);
-    SyscallWinFillRectangle(layer_id | LAYER_NO_REDRAW,
-                            4 + x, 24 + y, 2, 2, 0xfff100);
+    pixel_at(x, y)[0] = pixel_at(x, y)[1] = star_color;
+    pixel_at(x, y + 1)[0] = pixel_at(x, y + 1)[1] = star_color;
   }
-  SyscallWinRedraw(layer_id);
+  const AppRect canvas{4, 24, kWidth, kHeight};
+  SyscallWinCommit(layer_id, &canvas, 1);
 
   auto tick_end = SyscallGetCurrentTick();
   printf("%d stars in %lu ms.\n",
@@ -31,3 +31,12 @@ define_syscall ReadFile,         0x8000000d
 define_syscall DemandPages,      0x8000000e
 define_syscall MapFile,          0x8000000f
 define_syscall IsTerminal,       0x80000010
+define_syscall CreateThread,     0x80000011
+define_syscall JoinThread,       0x80000012
+define_syscall SubmitRing,       0x80000013
+define_syscall WinBlit,          0x80000014
+define_syscall MapWindowSurface, 0x80000015
+define_syscall WinCommit,        0x80000016
+define_syscall WinSetAlphaBlend, 0x80000017
+define_syscall WriteVec,         0x80000018
+define_syscall Splice,           0x80000019
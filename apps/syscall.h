@@ -10,6 +10,9 @@ extern "C" {
 
 #include "../kernel/logger.hpp"
 #include "../kernel/app_event.hpp"
+#include "../kernel/syscall_ring.hpp"
+#include "../kernel/app_graphics.hpp"
+#include "../kernel/app_io.hpp"
 
 struct SyscallResult {
   uint64_t value;
@@ -45,6 +48,42 @@ struct SyscallResult SyscallDemandPages(size_t num_pages, int flags);
 struct SyscallResult SyscallMapFile(int fd, size_t* file_size, int flags);
 struct SyscallResult SyscallIsTerminal(int fd);
 
+/* entry(arg1, arg2) を新しいスレッドとして実行する。stack_size が 0 なら 64KiB。
+ * スレッドは SyscallExit で終了する（プロセス全体ではなくそのスレッドだけが終わる）。 */
+struct SyscallResult SyscallCreateThread(
+    void (*entry)(uint64_t, uint64_t), uint64_t arg1, uint64_t arg2,
+    size_t stack_size);
+struct SyscallResult SyscallJoinThread(uint64_t thread_id);
+
+/* SyscallCreateThread の entry に渡すと func(arg) を実行し，その戻り値で終了する */
+void ThreadEntry(uint64_t func, uint64_t arg) __attribute__((noreturn));
+
+/* ring に積まれた要求をまとめて処理し，処理した要求数を返す */
+struct SyscallResult SyscallSubmitRing(struct SyscallRing* ring);
+
+/* src の画素をウィンドウの (x, y) へまとめて転送し，書き込んだ画素数を返す */
+struct SyscallResult SyscallWinBlit(
+    uint64_t layer_id_flags, int x, int y, const struct AppPixelBuffer* src);
+
+/* ウィンドウの描画領域をアプリのアドレス空間に割り当て，surface に設定する。
+ * surface->pixels への書き込みは SyscallWinCommit で画面に反映される。 */
+struct SyscallResult SyscallMapWindowSurface(
+    uint64_t layer_id, struct AppSurface* surface);
+/* rects で示した範囲を再描画する。num_rects が 0 ならウィンドウ全体。
+ * 重なる矩形や隣り合う矩形はカーネル側でまとめてから描画する。
+ * LAYER_NO_REDRAW を付けて描いた後の再描画範囲の指定にも使える。 */
+struct SyscallResult SyscallWinCommit(
+    uint64_t layer_id, const struct AppRect* rects, size_t num_rects);
+/* enable が 0 以外なら，描画領域の各画素の最上位バイトを不透明度（255 で不透明）として
+ * 下のウィンドウに重ねる。有効にした時点の画素はすべて不透明になる。 */
+struct SyscallResult SyscallWinSetAlphaBlend(uint64_t layer_id_flags, int enable);
+/* iov[0..iovcnt) の各区間を順に fd へ書き込み，書き込んだ合計バイト数を返す */
+struct SyscallResult SyscallWriteVec(
+    int fd, const struct AppIoVec* iov, int iovcnt);
+/* fd_in から最大 len バイトを読んで fd_out へ書き込み，書き込んだバイト数を返す。
+ * データはカーネル内で直接受け渡され，アプリのバッファを経由しない。 */
+struct SyscallResult SyscallSplice(int fd_in, int fd_out, size_t len);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -486,9 +486,20 @@ int main(int argc, char** argv) {
     }
   };
 
+  // LAYER_NO_REDRAW で描いた範囲。flush_damage でまとめて画面に反映する
+  std::vector<AppRect> damage;
+  auto flush_damage = [&, hwnd = hwnd]() {
+    if (!damage.empty()) {
+      SyscallWinCommit(hwnd, damage.data(), damage.size());
+      damage.clear();
+    }
+  };
+
   auto draw_cursor = [&, hwnd = hwnd](bool show, bool redraw) {
     int cx = X_OFFSET + X_PADDING + CHAR_WIDTH * cursor_x;
     int cy = Y_OFFSET + Y_PADDING + CHAR_HEIGHT * (cursor_y - scroll_y);
+    // 1 文字は最大で 2 枠分の幅
+    damage.push_back(AppRect{cx, cy, CHAR_WIDTH * 2, CHAR_HEIGHT});
     if (show) {
       // キャレットを出す
       SyscallWinDrawLine(hwnd | LAYER_NO_REDRAW,
@@ -508,7 +519,7 @@ int main(int argc, char** argv) {
         }
       }
     }
-    if (redraw) SyscallWinRedraw(hwnd);
+    if (redraw) flush_damage();
   };
 
   // draw_from, draw_to : 画面における描画範囲
@@ -518,6 +529,9 @@ int main(int argc, char** argv) {
            (draw_to < 0 || i <= (unsigned int)draw_to) && i < (unsigned int)height;
            i++) {
         size_t idx = scroll_y + i;
+        damage.push_back(AppRect{X_OFFSET + X_PADDING,
+                                 Y_OFFSET + Y_PADDING + CHAR_HEIGHT * (int)i,
+                                 CHAR_WIDTH * width, CHAR_HEIGHT});
         if (idx < data.size()) {
           DrawLine(char_idx[i], hwnd, X_OFFSET + X_PADDING,
                    Y_OFFSET + Y_PADDING + CHAR_HEIGHT * i, width, tab_size,
@@ -532,6 +546,7 @@ int main(int argc, char** argv) {
     if (cursor_on) draw_cursor(true, false);
   };
   draw_lines(0, -1);
+  damage.clear();
   SyscallWinRedraw(hwnd);
 
   SyscallCreateTimer(TIMER_ONESHOT_REL, CURSOR_TIMER_VALUE, CURSOR_TIMER_INTERVAL_MS);
@@ -539,22 +554,22 @@ int main(int argc, char** argv) {
   bool exit_flag = false;
 
   // ダイアログの各ボタンを押した時の動作
-  auto dialog_save_pressed = [&, hwnd = hwnd]() {
+  auto dialog_save_pressed = [&]() {
     if (SaveFile(file_name, data)) {
       exit_flag = true;
     } else {
       // 保存に失敗したので、終了せずダイアログを閉じる
       draw_lines(0, -1);
-      SyscallWinRedraw(hwnd);
+      flush_damage();
       dialog_shown = false;
     }
   };
   auto dialog_discard_pressed = [&]() {
     exit_flag = true;
   };
-  auto dialog_cancel_pressed = [&, hwnd = hwnd]() {
+  auto dialog_cancel_pressed = [&]() {
     draw_lines(0, -1);
-    SyscallWinRedraw(hwnd);
+    flush_damage();
     dialog_shown = false;
   };
 
@@ -573,7 +588,7 @@ int main(int argc, char** argv) {
         if (dialog_shown) {
           dialog_shown = false;
           draw_lines(0, -1);
-          SyscallWinRedraw(hwnd);
+          flush_damage();
         } else if (edited) {
           DrawDialog(hwnd, dialog_x, dialog_y);
           SyscallWinRedraw(hwnd);
@@ -842,7 +857,7 @@ int main(int argc, char** argv) {
           cursor_x = new_cursor_x;
           cursor_y = new_cursor_y;
           draw_lines(redraw_from, redraw_to);
-          SyscallWinRedraw(hwnd);
+          flush_damage();
         }
         break;
     }
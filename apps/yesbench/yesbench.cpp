@@ -0,0 +1,35 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "../syscall.h"
+
+// yes と同じく 1 行ずつ write して，端末への出力がどれだけ速いかを測る
+int main(int argc, char** argv) {
+  int num_lines = 10000;
+  const char* word = "y";
+  if (argc >= 2) {
+    num_lines = atoi(argv[1]);
+  }
+  if (argc >= 3) {
+    word = argv[2];
+  }
+
+  char line[128];
+  snprintf(line, sizeof(line), "%s\n", word);
+  const size_t len = strlen(line);
+
+  auto [tick_start, timer_freq] = SyscallGetCurrentTick();
+  for (int i = 0; i < num_lines; ++i) {
+    SyscallPutString(1, line, len);
+  }
+  auto tick_end = SyscallGetCurrentTick().value;
+
+  const unsigned long ms = (tick_end - tick_start) * 1000 / timer_freq;
+  if (ms == 0) {
+    printf("%d lines in < %lu ms\n", num_lines, 1000 / timer_freq);
+  } else {
+    printf("%d lines in %lu ms (%lu lines/s)\n",
+           num_lines, ms, num_lines * 1000ul / ms);
+  }
+  return 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* アプリが用意した画素配列の形式 */
+enum AppPixelFormat {
+  kAppPixelXRGB8888, /* uint32_t 0x00RRGGBB（描画系システムコールの色と同じ） */
+  kAppPixelRGB888,   /* R, G, B の 3 バイト */
+  kAppPixelRGBA8888, /* R, G, B, A の 4 バイト（A は無視） */
+  kAppPixelGray8,    /* 輝度 1 バイト */
+  kAppPixelGrayA88,  /* 輝度, A の 2 バイト（A は無視） */
+};
+
+/* WinBlit の転送元 */
+struct AppPixelBuffer {
+  const void* pixels;
+  int width, height;
+  int stride; /* 1 行のバイト数 */
+  enum AppPixelFormat format;
+};
+
+/* ウィンドウ内の矩形（ウィンドウ左上が原点） */
+struct AppRect {
+  int x, y, w, h;
+};
+
+/* MapWindowSurface で得られるウィンドウの描画領域。
+ * format は kAppPixelXRGB8888 か kAppPixelRGBA8888（画面と同じ形式）のどちらか。
+ * WinSetAlphaBlend で合成を有効にしたウィンドウでは，X や A のバイト
+ * （uint32_t として見たときの最上位バイト）が不透明度になる。
+ * 書き込んだ内容は WinCommit で画面に反映される。 */
+struct AppSurface {
+  void* pixels;
+  int width, height;
+  int stride; /* 1 行のバイト数 */
+  enum AppPixelFormat format;
+};
+
+/* 0x00RRGGBB 形式の色を surface の 1 画素（uint32_t）に変換する */
+static inline uint32_t AppSurfaceColor(const struct AppSurface* surface,
+                                       uint32_t rgb) {
+  if (surface->format == kAppPixelRGBA8888) {
+    return (rgb >> 16 & 0xff) | (rgb & 0xff00) | (rgb & 0xff) << 16;
+  }
+  return rgb;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
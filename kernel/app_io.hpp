@@ -0,0 +1,18 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* WriteVec で書き込む 1 区間（Linux の struct iovec と同じ配置） */
+struct AppIoVec {
+  const void* base;
+  size_t len;
+};
+
+/* WriteVec に一度に渡せる区間数の上限 */
+#define APP_IOV_MAX 1024
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -187,7 +187,7 @@ RestoreContext:  ; void RestoreContext(void* task_context);
     o64 iret
 
 global CallApp
-CallApp:  ; int CallApp(int argc, char** argv, uint16_t ss,
+CallApp:  ; int CallApp(uint64_t arg1, uint64_t arg2, uint16_t ss,
           ;             uint64_t rip, uint64_t rsp, uint64_t* os_stack_ptr);
     push rbx
     push rbp
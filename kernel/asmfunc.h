@@ -18,7 +18,7 @@ extern "C" {
   void SwitchContext(void* next_ctx, void* current_ctx);
   void RestoreContext(void* ctx);
   unsigned int getEAX();
-  int CallApp(int argc, char** argv, uint16_t ss, uint64_t rip, uint64_t rsp, uint64_t* os_stack_ptr);
+  int CallApp(uint64_t arg1, uint64_t arg2, uint16_t ss, uint64_t rip, uint64_t rsp, uint64_t* os_stack_ptr);
   void IntHandlerLAPICTimer();
   void LoadTR(uint16_t sel);
   void WriteMSR(uint32_t msr, uint64_t value);
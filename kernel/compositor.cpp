@@ -0,0 +1,89 @@
+#include "compositor.hpp"
+
+#include "acpi.hpp"
+#include "asmfunc.h"
+#include "layer.hpp"
+#include "task.hpp"
+#include "terminal.hpp"
+#include "timer.hpp"
+
+const int kCompositorFrameTicks = (kTimerFreq + 59) / 60;
+
+namespace {
+  CompositorStat stat{};
+
+  // PM タイマーのカウント差をマイクロ秒に直す。24 ビットのタイマーでも 4 秒まで測れる
+  unsigned long ElapsedMicroseconds(uint32_t start, uint32_t end) {
+    const uint32_t count = (end - start) & 0x00ffffffu;
+    return static_cast<unsigned long>(count) * 1000000 / acpi::kPMTimerFreq;
+  }
+
+  void RecordFrame(unsigned long us) {
+    int bucket = 0;
+    for (unsigned long ms = us / 1000; ms > 0 && bucket < CompositorStat::kNumBuckets - 1; ms >>= 1) {
+      ++bucket;
+    }
+    ++stat.frames;
+    ++stat.histogram[bucket];
+    if (us > stat.max_us) {
+      stat.max_us = us;
+    }
+  }
+}
+
+void TaskCompositor(uint64_t task_id, int64_t data) {
+  __asm__("cli");
+  Task& task = task_manager->CurrentTask();
+  layer_manager->SetDeferred(true);
+  timer_manager->AddTimer(
+      Timer{timer_manager->CurrentTick() + kCompositorFrameTicks, 1, task_id});
+  __asm__("sti");
+
+  while (true) {
+    __asm__("cli");
+    auto msg = task.ReceiveMessage();
+    if (!msg) {
+      task.Sleep();
+      __asm__("sti");
+      continue;
+    }
+    __asm__("sti");
+
+    if (msg->type != Message::kTimerTimeout) {
+      continue;
+    }
+
+    // 合成が間に合わなかったフレームは飛ばし，周期を保つ
+    __asm__("cli");
+    auto next = msg->arg.timer.timeout + kCompositorFrameTicks;
+    const auto now = timer_manager->CurrentTick();
+    if (next <= now) {
+      next = now + kCompositorFrameTicks - (now - next) % kCompositorFrameTicks;
+    }
+    timer_manager->AddTimer(Timer{next, 1, task_id});
+    __asm__("sti");
+
+    // アプリの実行中に溜まったままのターミナル出力もここで描く
+    Terminal::FlushPendingOutputs();
+
+    const uint32_t start = IoIn32(acpi::fadt->pm_tmr_blk);
+    if (layer_manager->Flush() == 0) {
+      __asm__("cli");
+      ++stat.idle_frames;
+      __asm__("sti");
+      continue;
+    }
+    const uint32_t end = IoIn32(acpi::fadt->pm_tmr_blk);
+
+    __asm__("cli");
+    RecordFrame(ElapsedMicroseconds(start, end));
+    __asm__("sti");
+  }
+}
+
+CompositorStat GetCompositorStat() {
+  __asm__("cli");
+  const auto s = stat;
+  __asm__("sti");
+  return s;
+}
@@ -0,0 +1,29 @@
+/**
+ * @file compositor.hpp
+ *
+ * 一定の周期で画面を合成するコンポジタタスクを提供する。
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+/** @brief 1 フレームの合成にかかった時間の分布 */
+struct CompositorStat {
+  /** @brief 度数分布の階級数。i 番目は 2^(i-1) 以上 2^i ミリ秒未満（最後は上限なし） */
+  static const int kNumBuckets = 7;
+
+  unsigned long frames;       // 合成したフレーム数
+  unsigned long idle_frames;  // 再描画範囲が無く合成を省いたフレーム数
+  unsigned long max_us;       // 最も長かったフレームの合成時間（マイクロ秒）
+  std::array<unsigned long, kNumBuckets> histogram;
+};
+
+/** @brief コンポジタのフレーム間隔（タイマー割り込みの回数）。約 60Hz 以下で最も短い間隔。 */
+extern const int kCompositorFrameTicks;
+
+/** @brief レイヤー描画を遅延描画に切り替え，一定周期で再描画範囲をまとめて合成するタスク。 */
+void TaskCompositor(uint64_t task_id, int64_t data);
+/** @brief コンポジタの統計情報を返す。 */
+CompositorStat GetCompositorStat();
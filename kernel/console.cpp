@@ -6,6 +6,7 @@
 
 #include "console.hpp"
 
+#include <algorithm>
 #include <cstring>
 #include "font.hpp"
 #include "layer.hpp"
@@ -19,12 +20,20 @@ void Console::PutString(const char* s) {
   while (*s) {
     if (*s == '\n') {
       Newline();
-    } else if (cursor_column_ < kColumns - 1) {
-      WriteAscii(*writer_, Vector2D<int>{8 * cursor_column_, 16 * cursor_row_}, *s, fg_color_);
-      buffer_[cursor_row_][cursor_column_] = *s;
-      ++cursor_column_;
+      ++s;
+      continue;
     }
-    ++s;
+
+    // 改行までの文字のうち，行に収まる分をまとめて描く
+    const int len = strcspn(s, "\n");
+    const int n = std::min(len, kColumns - 1 - cursor_column_);
+    if (n > 0) {
+      WriteAsciiRun(*writer_, Vector2D<int>{8 * cursor_column_, 16 * cursor_row_},
+                    s, n, fg_color_);
+      memcpy(&buffer_[cursor_row_][cursor_column_], s, n);
+      cursor_column_ += n;
+    }
+    s += len;
   }
   if (layer_manager) {
     layer_manager->Draw(layer_id_);
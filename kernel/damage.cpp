@@ -0,0 +1,75 @@
+#include "damage.hpp"
+
+namespace {
+  int Area(const Rectangle<int>& r) {
+    return r.size.x * r.size.y;
+  }
+
+  Rectangle<int> BoundingBox(const Rectangle<int>& a, const Rectangle<int>& b) {
+    const auto pos = ElementMin(a.pos, b.pos);
+    const auto end = ElementMax(a.pos + a.size, b.pos + b.size);
+    return {pos, end - pos};
+  }
+
+  bool ShouldMerge(const Rectangle<int>& a, const Rectangle<int>& b) {
+    const auto overlap = a & b;
+    if (overlap.size.x > 0 && overlap.size.y > 0) {
+      return true;
+    }
+    return Area(BoundingBox(a, b)) <= Area(a) + Area(b);
+  }
+}
+
+void DamageList::Add(const Rectangle<int>& rect) {
+  if (rect.size.x <= 0 || rect.size.y <= 0) {
+    return;
+  }
+
+  // 併合で大きくなった矩形が別の矩形と併合可能になることがあるので，
+  // 併合できる相手がなくなるまで先頭から探し直す
+  auto r = rect;
+  for (size_t i = 0; i < rects_.size();) {
+    if (ShouldMerge(rects_[i], r)) {
+      r = BoundingBox(rects_[i], r);
+      rects_[i] = rects_.back();
+      rects_.pop_back();
+      i = 0;
+    } else {
+      ++i;
+    }
+  }
+  rects_.push_back(r);
+
+  if (rects_.size() > kMaxRects) {
+    for (size_t i = 1; i < rects_.size(); ++i) {
+      rects_[0] = BoundingBox(rects_[0], rects_[i]);
+    }
+    rects_.resize(1);
+  }
+}
+
+void SubtractRect(const Rectangle<int>& a, const Rectangle<int>& b,
+                  std::vector<Rectangle<int>>& out) {
+  const auto overlap = a & b;
+  if (overlap.size.x <= 0 || overlap.size.y <= 0) {
+    out.push_back(a);
+    return;
+  }
+
+  const auto a_end = a.pos + a.size;
+  const auto overlap_end = overlap.pos + overlap.size;
+  // 上下は a の幅いっぱい，左右は重なった部分の高さだけ
+  if (a.pos.y < overlap.pos.y) {
+    out.push_back({a.pos, {a.size.x, overlap.pos.y - a.pos.y}});
+  }
+  if (overlap_end.y < a_end.y) {
+    out.push_back({{a.pos.x, overlap_end.y}, {a.size.x, a_end.y - overlap_end.y}});
+  }
+  if (a.pos.x < overlap.pos.x) {
+    out.push_back({{a.pos.x, overlap.pos.y}, {overlap.pos.x - a.pos.x, overlap.size.y}});
+  }
+  if (overlap_end.x < a_end.x) {
+    out.push_back({{overlap_end.x, overlap.pos.y},
+                   {a_end.x - overlap_end.x, overlap.size.y}});
+  }
+}
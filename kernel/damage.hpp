@@ -0,0 +1,35 @@
+/**
+ * @file damage.hpp
+ *
+ * 再描画が必要な矩形の集合を管理する。
+ */
+
+#pragma once
+
+#include <vector>
+#include "graphics.hpp"
+
+/** @brief DamageList は再描画が必要な矩形の集合を保持する。
+ *
+ * 追加された矩形は，既存の矩形と重なる場合や，外接矩形にまとめても
+ * 描画する面積が増えない場合（隣り合う行など）に 1 つへ併合する。
+ */
+class DamageList {
+ public:
+  /** @brief 保持する矩形数の上限。超えたらすべてを 1 つの外接矩形にまとめる。 */
+  static const size_t kMaxRects = 16;
+
+  /** @brief 矩形を追加する。幅か高さが 0 以下の矩形は無視する。 */
+  void Add(const Rectangle<int>& rect);
+  /** @brief 併合済みの矩形の一覧を返す。 */
+  const std::vector<Rectangle<int>>& Rects() const { return rects_; }
+  bool Empty() const { return rects_.empty(); }
+  void Clear() { rects_.clear(); }
+
+ private:
+  std::vector<Rectangle<int>> rects_{};
+};
+
+/** @brief 矩形 a から b と重なる部分を除いた残りを，重ならない矩形（最大 4 個）として out に追加する。 */
+void SubtractRect(const Rectangle<int>& a, const Rectangle<int>& b,
+                  std::vector<Rectangle<int>>& out);
@@ -1,10 +1,14 @@
 #include "fat.hpp"
 
 #include <algorithm>
+#include <array>
 #include <cstring>
 #include <cctype>
+#include <map>
 #include <utility>
 
+#include "interrupt.hpp"
+
 namespace {
 
 std::pair<const char*, bool>
@@ -36,11 +40,152 @@ namespace fat {
 BPB* boot_volume_image;
 unsigned long bytes_per_cluster;
 
+namespace {
+
+// FAT32 の FSInfo セクタ
+struct FSInfo {
+  uint32_t lead_signature;
+  uint8_t reserved1[480];
+  uint32_t struct_signature;
+  uint32_t free_count;
+  uint32_t next_free;
+  uint8_t reserved2[12];
+  uint32_t trail_signature;
+} __attribute__((packed));
+
+FSInfo* fs_info;
+// 使用中のクラスタのビットマップ（1 が使用中）。マウント時に FAT から作る
+std::vector<uint64_t> used_clusters;
+unsigned long cluster_end; // 有効なクラスタ番号は [2, cluster_end)
+unsigned long next_free_cluster = 2; // 次に空きを探し始める位置（next-fit）
+
+bool IsFreeCluster(unsigned long cluster) {
+  return 2 <= cluster && cluster < cluster_end &&
+    (used_clusters[cluster / 64] >> (cluster % 64) & 1) == 0;
+}
+
+void MarkClusterUsed(unsigned long cluster) {
+  used_clusters[cluster / 64] |= uint64_t{1} << (cluster % 64);
+  next_free_cluster = cluster + 1 < cluster_end ? cluster + 1 : 2;
+  if (fs_info) {
+    --fs_info->free_count;
+    fs_info->next_free = next_free_cluster;
+  }
+}
+
+/** @brief from 以降（末尾まで来たら先頭に戻る）で最初の空きクラスタを返す。なければ 0 */
+unsigned long FindFreeCluster(unsigned long from) {
+  if (from < 2 || from >= cluster_end) {
+    from = 2;
+  }
+  for (unsigned long i = 0; i < used_clusters.size() + 1; ++i) {
+    const unsigned long word = (from / 64 + i) % used_clusters.size();
+    uint64_t free_bits = ~used_clusters[word];
+    if (i == 0) {
+      free_bits &= ~uint64_t{0} << (from % 64);
+    }
+    while (free_bits != 0) {
+      const unsigned long cluster = word * 64 + __builtin_ctzll(free_bits);
+      if (IsFreeCluster(cluster)) {
+        return cluster;
+      }
+      free_bits &= free_bits - 1;
+    }
+  }
+  return 0;
+}
+
+/** @brief n 個連続した空きクラスタの先頭を探す。見つからなければ最初の空きクラスタを返す */
+unsigned long FindFreeRun(unsigned long from, size_t n) {
+  const auto first_free = FindFreeCluster(from);
+  auto start = first_free;
+  bool wrapped = false; // 末尾から先頭に戻ったか
+  while (start != 0) {
+    size_t len = 1;
+    while (len < n && IsFreeCluster(start + len)) {
+      ++len;
+    }
+    if (len == n) {
+      return start;
+    }
+
+    if (wrapped && start + len >= first_free) { // 一周した
+      break;
+    }
+    const auto next = FindFreeCluster(start + len);
+    if (next <= start) {
+      if (wrapped) {
+        break;
+      }
+      wrapped = true;
+    }
+    if (wrapped && next >= first_free) {
+      break;
+    }
+    start = next;
+  }
+  return first_free;
+}
+
+/** @brief 空きクラスタを 1 つ確保する。prefer が空いていればそれを使う。なければ 0 */
+unsigned long AllocateCluster(unsigned long prefer) {
+  const auto cluster =
+    IsFreeCluster(prefer) ? prefer : FindFreeCluster(next_free_cluster);
+  if (cluster != 0) {
+    MarkClusterUsed(cluster);
+  }
+  return cluster;
+}
+
+} // namespace
+
 void Initialize(void* volume_image) {
   boot_volume_image = reinterpret_cast<fat::BPB*>(volume_image);
   bytes_per_cluster =
     static_cast<unsigned long>(boot_volume_image->bytes_per_sector) *
     boot_volume_image->sectors_per_cluster;
+
+  const auto bpb = boot_volume_image;
+  const unsigned long total_sectors =
+    bpb->total_sectors_16 ? bpb->total_sectors_16 : bpb->total_sectors_32;
+  const unsigned long data_start =
+    bpb->reserved_sector_count + bpb->num_fats * bpb->fat_size_32;
+  cluster_end = std::min(
+      (total_sectors - data_start) / bpb->sectors_per_cluster + 2,
+      static_cast<unsigned long>(bpb->fat_size_32) * bpb->bytes_per_sector / 4);
+
+  used_clusters.assign((cluster_end + 63) / 64, 0);
+  const uint32_t* fat = GetFAT();
+  uint32_t num_free = 0;
+  for (unsigned long cluster = 0; cluster < cluster_end; ++cluster) {
+    if (cluster < 2 || fat[cluster] != 0) {
+      used_clusters[cluster / 64] |= uint64_t{1} << (cluster % 64);
+    } else {
+      ++num_free;
+    }
+  }
+  // cluster_end 以降の番号は使用中として扱う
+  for (unsigned long cluster = cluster_end; cluster < used_clusters.size() * 64; ++cluster) {
+    used_clusters[cluster / 64] |= uint64_t{1} << (cluster % 64);
+  }
+
+  fs_info = nullptr;
+  if (bpb->fs_info != 0 && bpb->fs_info != 0xffff) {
+    auto info = reinterpret_cast<FSInfo*>(
+        reinterpret_cast<uintptr_t>(bpb) + bpb->fs_info * bpb->bytes_per_sector);
+    if (info->lead_signature == 0x41615252 &&
+        info->struct_signature == 0x61417272) {
+      fs_info = info;
+    }
+  }
+
+  next_free_cluster = 2;
+  if (fs_info) {
+    if (2 <= fs_info->next_free && fs_info->next_free < cluster_end) {
+      next_free_cluster = fs_info->next_free;
+    }
+    fs_info->free_count = num_free;
+  }
 }
 
 uintptr_t GetClusterAddr(unsigned long cluster) {
@@ -110,6 +255,85 @@ unsigned long NextCluster(unsigned long cluster) {
   return next;
 }
 
+namespace {
+
+using Name83 = std::array<unsigned char, 11>;
+
+/** @brief name を 8.3 形式（空白で埋めた大文字 11 バイト）に変換する。8.3 で表せなければ false */
+bool ToName83(const char* name, Name83& name83) {
+  name83.fill(0x20);
+
+  int i = 0;
+  int i83 = 0;
+  bool found_dot = false;
+  for (; name[i] != 0 && i83 < name83.size(); ++i, ++i83) {
+    if (name[i] == '.') {
+      if (found_dot) return false; // ドットが2個以上ある
+      i83 = 7;
+      found_dot = true;
+      continue;
+    }
+    if (!found_dot && i > 7) return false; // ドットの前に9文字以上ある
+    name83[i83] = toupper(name[i]);
+  }
+  return name[i] == 0;
+}
+
+// (ディレクトリの先頭クラスタ, 8.3 形式の名前) → エントリ。見つからなかった名前は nullptr を覚える
+const size_t kMaxDentries = 256;
+std::map<std::pair<unsigned long, Name83>, DirectoryEntry*> dentry_cache;
+// エントリを追加するたびに進める。探索中に追加があればその結果はキャッシュしない
+unsigned long dentry_generation = 0;
+
+void InvalidateDentries() {
+  const bool intr = DisableInterrupts();
+  dentry_cache.clear();
+  ++dentry_generation;
+  if (intr) __asm__("sti");
+}
+
+DirectoryEntry* ScanDirectory(unsigned long directory_cluster, const Name83& name83) {
+  while (directory_cluster != kEndOfClusterchain) {
+    auto dir = GetSectorByCluster<DirectoryEntry>(directory_cluster);
+    for (int i = 0; i < bytes_per_cluster / sizeof(DirectoryEntry); ++i) {
+      if (dir[i].name[0] == 0x00) {
+        return nullptr;
+      } else if (memcmp(dir[i].name, name83.data(), name83.size()) == 0) {
+        return &dir[i];
+      }
+    }
+    directory_cluster = NextCluster(directory_cluster);
+  }
+  return nullptr;
+}
+
+DirectoryEntry* LookupDentry(unsigned long directory_cluster, const Name83& name83) {
+  const auto key = std::make_pair(directory_cluster, name83);
+
+  bool intr = DisableInterrupts();
+  if (auto it = dentry_cache.find(key); it != dentry_cache.end()) {
+    const auto entry = it->second;
+    if (intr) __asm__("sti");
+    return entry;
+  }
+  const auto generation = dentry_generation;
+  if (intr) __asm__("sti");
+
+  const auto entry = ScanDirectory(directory_cluster, name83);
+
+  intr = DisableInterrupts();
+  if (generation == dentry_generation) {
+    if (dentry_cache.size() >= kMaxDentries) {
+      dentry_cache.clear();
+    }
+    dentry_cache[key] = entry;
+  }
+  if (intr) __asm__("sti");
+  return entry;
+}
+
+} // namespace
+
 std::pair<DirectoryEntry*, bool>
 FindFile(const char* path, unsigned long directory_cluster) {
   if (path[0] == '/') {
@@ -123,49 +347,28 @@ FindFile(const char* path, unsigned long directory_cluster) {
   const auto [ next_path, post_slash ] = NextPathElement(path, path_elem);
   const bool path_last = next_path == nullptr || next_path[0] == '\0';
 
-  while (directory_cluster != kEndOfClusterchain) {
-    auto dir = GetSectorByCluster<DirectoryEntry>(directory_cluster);
-    for (int i = 0; i < bytes_per_cluster / sizeof(DirectoryEntry); ++i) {
-      if (dir[i].name[0] == 0x00) {
-        goto not_found;
-      } else if (!NameIsEqual(dir[i], path_elem)) {
-        continue;
-      }
-
-      if (dir[i].attr == Attribute::kDirectory && !path_last) {
-        return FindFile(next_path, dir[i].FirstCluster());
-      } else {
-        // dir[i] がディレクトリではないか，パスの末尾に来てしまったので探索をやめる
-        return { &dir[i], post_slash };
-      }
-    }
+  // 探す名前の 8.3 形式は 1 度だけ作り，各エントリとはバイト列で比べる
+  Name83 name83;
+  if (!ToName83(path_elem, name83)) {
+    return { nullptr, post_slash };
+  }
 
-    directory_cluster = NextCluster(directory_cluster);
+  auto entry = LookupDentry(directory_cluster, name83);
+  if (entry == nullptr) {
+    return { nullptr, post_slash };
   }
 
-not_found:
-  return { nullptr, post_slash };
+  if (entry->attr == Attribute::kDirectory && !path_last) {
+    return FindFile(next_path, entry->FirstCluster());
+  }
+  // entry がディレクトリではないか，パスの末尾に来てしまったので探索をやめる
+  return { entry, post_slash };
 }
 
 bool NameIsEqual(const DirectoryEntry& entry, const char* name) {
-  unsigned char name83[11];
-  memset(name83, 0x20, sizeof(name83));
-
-  int i = 0;
-  int i83 = 0;
-  bool found_dot = false;
-  for (; name[i] != 0 && i83 < sizeof(name83); ++i, ++i83) {
-    if (name[i] == '.') {
-      if (found_dot) return false; // ドットが2個以上ある
-      i83 = 7;
-      found_dot = true;
-      continue;
-    }
-    if (!found_dot && i > 7) return false; // ドットの前に9文字以上ある
-    name83[i83] = toupper(name[i]);
-  }
-
-  return name[i] == 0 && memcmp(entry.name, name83, sizeof(name83)) == 0;
+  Name83 name83;
+  return ToName83(name, name83) &&
+    memcmp(entry.name, name83.data(), name83.size()) == 0;
 }
 
 size_t LoadFile(void* buf, size_t len, DirectoryEntry& entry) {
@@ -190,22 +393,25 @@ unsigned long ExtendCluster(unsigned long eoc_cluster, size_t n) {
     eoc_cluster = fat[eoc_cluster];
   }
 
-  size_t num_allocated = 0;
   auto current = eoc_cluster;
-
-  for (unsigned long candidate = 2; num_allocated < n; ++candidate) {
-    if (fat[candidate] != 0) { // candidate cluster is not free
-      continue;
+  for (size_t i = 0; i < n; ++i) {
+    // 直後のクラスタが空いていれば使い，チェーンをなるべく連続させる
+    const auto cluster = AllocateCluster(current + 1);
+    if (cluster == 0) {
+      break;
     }
-    fat[current] = candidate;
-    current = candidate;
-    ++num_allocated;
+    fat[current] = cluster;
+    current = cluster;
   }
   fat[current] = kEndOfClusterchain;
+  if (n > 0 && current == eoc_cluster) {
+    return 0;
+  }
   return current;
 }
 
 DirectoryEntry* AllocateEntry(unsigned long dir_cluster) {
+  InvalidateDentries();
   while (true) {
     auto dir = GetSectorByCluster<DirectoryEntry>(dir_cluster);
     for (int i = 0; i < bytes_per_cluster / sizeof(DirectoryEntry); ++i) {
@@ -221,6 +427,9 @@ DirectoryEntry* AllocateEntry(unsigned long dir_cluster) {
   }
 
   dir_cluster = ExtendCluster(dir_cluster, 1);
+  if (dir_cluster == 0) {
+    return nullptr;
+  }
   auto dir = GetSectorByCluster<DirectoryEntry>(dir_cluster);
   memset(dir, 0, bytes_per_cluster);
   return &dir[0];
@@ -268,22 +477,21 @@ WithError<DirectoryEntry*> CreateFile(const char* path) {
 
   auto dir = fat::AllocateEntry(parent_dir_cluster);
   if (dir == nullptr) {
-    return { nullptr, MAKE_ERROR(Error::kNoEnoughMemory) };
+    return { nullptr, MAKE_ERROR(Error::kFull) };
   }
   fat::SetFileName(*dir, filename);
   dir->file_size = 0;
+  InvalidateDentries();
   return { dir, MAKE_ERROR(Error::kSuccess) };
 }
 
 unsigned long AllocateClusterChain(size_t n) {
   uint32_t* fat = GetFAT();
-  unsigned long first_cluster;
-  for (first_cluster = 2; ; ++first_cluster) {
-    if (fat[first_cluster] == 0) {
-      fat[first_cluster] = kEndOfClusterchain;
-      break;
-    }
+  const auto first_cluster = AllocateCluster(FindFreeRun(next_free_cluster, n));
+  if (first_cluster == 0) {
+    return 0;
   }
+  fat[first_cluster] = kEndOfClusterchain;
 
   if (n > 1) {
     ExtendCluster(first_cluster, n - 1);
@@ -320,18 +528,58 @@ size_t FileDescriptor::Read(void* buf, size_t len) {
   return total;
 }
 
+std::pair<const void*, size_t> FileDescriptor::ReadSpan(size_t len) {
+  if (rd_cluster_ == 0) {
+    rd_cluster_ = fat_entry_.FirstCluster();
+  }
+  len = std::min(len, fat_entry_.file_size - rd_off_);
+  if (len == 0 || rd_cluster_ == 0 || IsEndOfClusterchain(rd_cluster_)) {
+    return {nullptr, 0};
+  }
+
+  const uint8_t* p = GetSectorByCluster<uint8_t>(rd_cluster_) + rd_cluster_off_;
+  size_t total = std::min(len, bytes_per_cluster - rd_cluster_off_);
+  rd_cluster_off_ += total;
+
+  while (total < len && rd_cluster_off_ == bytes_per_cluster) {
+    const auto next_cluster = NextCluster(rd_cluster_);
+    if (next_cluster != rd_cluster_ + 1) {
+      break;
+    }
+    rd_cluster_ = next_cluster;
+    rd_cluster_off_ = std::min(len - total, bytes_per_cluster);
+    total += rd_cluster_off_;
+  }
+
+  if (rd_cluster_off_ == bytes_per_cluster) {
+    rd_cluster_ = NextCluster(rd_cluster_);
+    rd_cluster_off_ = 0;
+  }
+  rd_off_ += total;
+  return {p, total};
+}
+
 size_t FileDescriptor::Write(const void* buf, size_t len) {
   auto num_cluster = [](size_t bytes) {
     return (bytes + bytes_per_cluster - 1) / bytes_per_cluster;
   };
 
+  if (len == 0) {
+    return 0;
+  }
+
   if (wr_cluster_ == 0) {
     if (fat_entry_.FirstCluster() != 0) {
       wr_cluster_ = fat_entry_.FirstCluster();
     } else {
       wr_cluster_ = AllocateClusterChain(num_cluster(len));
+      if (wr_cluster_ == 0) { // 空きクラスタがない
+        return 0;
+      }
       fat_entry_.first_cluster_low = wr_cluster_ & 0xffff;
       fat_entry_.first_cluster_high = (wr_cluster_ >> 16) & 0xffff;
+      extents_.clear();
+      num_extent_clusters_ = 0;
     }
   }
 
@@ -342,7 +590,13 @@ size_t FileDescriptor::Write(const void* buf, size_t len) {
     if (wr_cluster_off_ == bytes_per_cluster) {
       const auto next_cluster = NextCluster(wr_cluster_);
       if (next_cluster == kEndOfClusterchain) {
-        wr_cluster_ = ExtendCluster(wr_cluster_, num_cluster(len - total));
+        const auto tail = ExtendCluster(wr_cluster_, num_cluster(len - total));
+        if (tail == 0) { // 空きクラスタがないので書けた分だけを返す
+          break;
+        }
+        wr_cluster_ = NextCluster(wr_cluster_);
+        extents_.clear();
+        num_extent_clusters_ = 0;
       } else {
         wr_cluster_ = next_cluster;
       }
@@ -363,18 +617,53 @@ size_t FileDescriptor::Write(const void* buf, size_t len) {
 }
 
 size_t FileDescriptor::Load(void* buf, size_t len, size_t offset) {
+  if (offset >= fat_entry_.file_size) {
+    return 0;
+  }
+
+  const auto cluster = ClusterAt(offset / bytes_per_cluster);
+  if (cluster == kEndOfClusterchain) {
+    return 0;
+  }
+
   FileDescriptor fd{fat_entry_};
   fd.rd_off_ = offset;
+  fd.rd_cluster_ = cluster;
+  fd.rd_cluster_off_ = offset % bytes_per_cluster;
+  return fd.Read(buf, len);
+}
+
+void FileDescriptor::BuildExtents() {
+  extents_.clear();
+  num_extent_clusters_ = 0;
 
   unsigned long cluster = fat_entry_.FirstCluster();
-  while (offset >= bytes_per_cluster) {
-    offset -= bytes_per_cluster;
+  while (cluster != 0 && cluster != kEndOfClusterchain) {
+    if (!extents_.empty() &&
+        extents_.back().cluster + extents_.back().length == cluster) {
+      ++extents_.back().length;
+    } else {
+      extents_.push_back({num_extent_clusters_, cluster, 1});
+    }
+    ++num_extent_clusters_;
     cluster = NextCluster(cluster);
   }
+}
 
-  fd.rd_cluster_ = cluster;
-  fd.rd_cluster_off_ = offset;
-  return fd.Read(buf, len);
+unsigned long FileDescriptor::ClusterAt(size_t index) {
+  if (index >= num_extent_clusters_) {
+    // 他の FileDescriptor がチェーンを伸ばしたかもしれないので作り直してみる
+    BuildExtents();
+    if (index >= num_extent_clusters_) {
+      return kEndOfClusterchain;
+    }
+  }
+
+  auto it = std::upper_bound(
+      extents_.begin(), extents_.end(), index,
+      [](size_t i, const Extent& e) { return i < e.file_cluster; });
+  --it;
+  return it->cluster + (index - it->file_cluster);
 }
 
 } // namespace fat
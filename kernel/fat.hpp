@@ -8,6 +8,7 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <vector>
 
 #include "error.hpp"
 #include "file.hpp"
@@ -160,7 +161,8 @@ uint32_t* GetFAT();
  *
  * @param eoc_cluster  伸長したいクラスタチェーンに属するいずれかのクラスタ番号
  * @param n  伸長するクラスタ数
- * @return  伸長後のチェーンにおける最後尾のクラスタ番号
+ * @return  伸長後のチェーンにおける最後尾のクラスタ番号。
+ *   空きクラスタが足りなければ確保できた分だけ伸長する。1 つも確保できなければ 0。
  */
 unsigned long ExtendCluster(unsigned long eoc_cluster, size_t n);
 
@@ -168,7 +170,7 @@ unsigned long ExtendCluster(unsigned long eoc_cluster, size_t n);
  * ディレクトリが満杯ならクラスタを 1 つ伸長して空きエントリを確保する。
  *
  * @param dir_cluster  空きエントリを探すディレクトリ
- * @return 空きエントリ
+ * @return 空きエントリ。ディレクトリを伸長できなければ nullptr
  */
 DirectoryEntry* AllocateEntry(unsigned long dir_cluster);
 
@@ -189,7 +191,7 @@ WithError<DirectoryEntry*> CreateFile(const char* path);
 /** @brief 指定した数の空きクラスタからなるチェーンを構築する。
  *
  * @param n  クラスタ数
- * @return  構築したチェーンの先頭クラスタ番号
+ * @return  構築したチェーンの先頭クラスタ番号。空きクラスタが 1 つもなければ 0
  */
 unsigned long AllocateClusterChain(size_t n);
 
@@ -200,6 +202,10 @@ class FileDescriptor : public ::FileDescriptor {
   size_t Write(const void* buf, size_t len) override;
   size_t Size() const override { return fat_entry_.file_size; }
   size_t Load(void* buf, size_t len, size_t offset) override;
+  /** @brief ボリュームイメージ上のデータをそのまま返す。
+   * 番号の連続するクラスタはメモリ上も連続しているので，1 つの領域にまとめる。
+   */
+  std::pair<const void*, size_t> ReadSpan(size_t len) override;
 
  private:
   DirectoryEntry& fat_entry_;
@@ -209,6 +215,19 @@ class FileDescriptor : public ::FileDescriptor {
   size_t wr_off_ = 0;
   unsigned long wr_cluster_ = 0;
   size_t wr_cluster_off_ = 0;
+
+  // 番号が連続するクラスタの並び。file_cluster はファイル先頭から数えたクラスタ番号
+  struct Extent {
+    size_t file_cluster;
+    unsigned long cluster;
+    size_t length;
+  };
+  // クラスタチェーンのエクステント表。必要になったときに作り，チェーンを伸ばしたら作り直す
+  std::vector<Extent> extents_{};
+  size_t num_extent_clusters_ = 0;
+  void BuildExtents();
+  /** @brief ファイル先頭から index 番目のクラスタ番号を返す。なければ kEndOfClusterchain */
+  unsigned long ClusterAt(size_t index);
 };
 
 } // namespace fat
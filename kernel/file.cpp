@@ -1,6 +1,8 @@
 #include "file.hpp"
 
+#include <algorithm>
 #include <cstdio>
+#include <memory>
 #include <vector>
 
 size_t PrintToFD(FileDescriptor& fd, const char* format, ...) {
@@ -39,3 +41,30 @@ size_t ReadDelim(FileDescriptor& fd, char delim, char* buf, size_t len) {
   buf[i] = '\0';
   return i;
 }
+
+size_t SpliceFD(FileDescriptor& src, FileDescriptor& dst, size_t len) {
+  constexpr size_t kBounceBytes = 64 * 1024;
+  std::unique_ptr<char[]> bounce;
+
+  size_t total = 0;
+  while (total < len) {
+    auto [ p, n ] = src.ReadSpan(len - total);
+    if (p == nullptr) {
+      if (!bounce) {
+        bounce.reset(new char[kBounceBytes]);
+      }
+      n = src.Read(bounce.get(), std::min(len - total, kBounceBytes));
+      p = bounce.get();
+    }
+    if (n == 0) {
+      break;
+    }
+
+    const size_t written = dst.Write(p, n);
+    total += written;
+    if (written < n) {
+      break;
+    }
+  }
+  return total;
+}
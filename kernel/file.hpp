@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstddef>
+#include <utility>
 #include "error.hpp"
 
 class FileDescriptor {
@@ -10,6 +11,12 @@ class FileDescriptor {
   virtual size_t Write(const void* buf, size_t len) = 0;
   virtual size_t Size() const = 0;
   virtual bool IsTerminal() const { return false; }
+  /** @brief 溜めてある書き込みがあれば出力先へ反映する */
+  virtual void Flush() {}
+  /** @brief 読み出し位置からのデータがメモリ上にあれば，その領域（最大 len バイト）を
+   * コピーせずに返して読み進める。そうでなければ {nullptr, 0} を返し，読み進めない。
+   */
+  virtual std::pair<const void*, size_t> ReadSpan(size_t len) { return {nullptr, 0}; }
 
   /** @brief Load reads file content without changing internal offset
    */
@@ -19,3 +26,11 @@ class FileDescriptor {
 size_t PrintToFD(FileDescriptor& fd, const char* format, ...)
     __attribute__((format(printf, 2, 3)));
 size_t ReadDelim(FileDescriptor& fd, char delim, char* buf, size_t len);
+/** @brief src から最大 len バイトを読み，ユーザバッファを介さずに dst へ書き込む。
+ *
+ * src が ReadSpan に対応していれば，そのメモリから直接 dst に書き込む。
+ *
+ * @return 書き込んだバイト数。src が終端に達するか dst への書き込みが途中で
+ *   止まると len より小さくなる。
+ */
+size_t SpliceFD(FileDescriptor& src, FileDescriptor& dst, size_t len);
@@ -6,10 +6,15 @@
 
 #include "font.hpp"
 
+#include <algorithm>
+#include <array>
 #include <cstdlib>
+#include <cstring>
+#include <map>
 #include <vector>
 
 #include "fat.hpp"
+#include "interrupt.hpp"
 #include "logger.hpp"
 
 extern const uint8_t _binary_hankaku_bin_start;
@@ -28,6 +33,7 @@ const uint8_t* GetFont(char c) {
 
 FT_Library ft_library;
 std::vector<uint8_t>* nihongo_buf;
+FT_Face nihongo_face;
 
 Error RenderUnicode(char32_t c, FT_Face face) {
   const auto glyph_index = FT_Get_Char_Index(face, c);
@@ -42,6 +48,151 @@ Error RenderUnicode(char32_t c, FT_Face face) {
   return MAKE_ERROR(Error::kSuccess);
 }
 
+/** @brief 描画済みの 1 ビット/画素のグリフ */
+struct Glyph {
+  static const int kMaxBitmapBytes = 4 * 24; // 幅 32 画素，高さ 24 画素まで
+
+  char32_t code;
+  bool found;          // フォントにグリフがあったか
+  Vector2D<int> topleft; // 描画位置からビットマップ左上までのずれ
+  int width, rows, pitch;
+  uint8_t bitmap[kMaxBitmapBytes];
+};
+
+/** @brief 最近使ったグリフを保持する。あふれたら最も長く使われていないものを捨てる。 */
+class GlyphCache {
+ public:
+  static const int kCapacity = 512;
+
+  /** @brief グリフを探し，見つかれば最も新しく使ったものとして返す。 */
+  const Glyph* Find(char32_t c) {
+    auto it = index_.find(c);
+    if (it == index_.end()) {
+      ++stat_.misses;
+      return nullptr;
+    }
+    ++stat_.hits;
+    Touch(it->second);
+    return &entries_[it->second].glyph;
+  }
+
+  /** @brief グリフを登録する。空きが無ければ最も長く使われていないものと入れ替える。 */
+  void Insert(const Glyph& glyph) {
+    int i;
+    if (num_entries_ < kCapacity) {
+      i = num_entries_++;
+    } else {
+      i = lru_tail_;
+      Unlink(i);
+      index_.erase(entries_[i].glyph.code);
+      ++stat_.evictions;
+    }
+    entries_[i].glyph = glyph;
+    index_[glyph.code] = i;
+    PushFront(i);
+  }
+
+  GlyphCacheStat Stat() const {
+    auto s = stat_;
+    s.entries = num_entries_;
+    s.capacity = kCapacity;
+    return s;
+  }
+
+ private:
+  struct Entry {
+    Glyph glyph;
+    int prev, next; // LRU リスト（先頭が最も新しい）
+  };
+  std::array<Entry, kCapacity> entries_;
+  std::map<char32_t, int> index_;
+  int num_entries_{0};
+  int lru_head_{-1}, lru_tail_{-1};
+  GlyphCacheStat stat_{};
+
+  void Unlink(int i) {
+    auto& e = entries_[i];
+    (e.prev >= 0 ? entries_[e.prev].next : lru_head_) = e.next;
+    (e.next >= 0 ? entries_[e.next].prev : lru_tail_) = e.prev;
+  }
+
+  void PushFront(int i) {
+    entries_[i].prev = -1;
+    entries_[i].next = lru_head_;
+    (lru_head_ >= 0 ? entries_[lru_head_].prev : lru_tail_) = i;
+    lru_head_ = i;
+  }
+
+  void Touch(int i) {
+    if (i != lru_head_) {
+      Unlink(i);
+      PushFront(i);
+    }
+  }
+};
+
+GlyphCache* glyph_cache;
+
+/** @brief nihongo_face で c を描画して glyph に写す。
+ *
+ * ビットマップが Glyph に収まらなければ kFull を返す。呼び出し側で割り込みを禁止しておく。
+ */
+Error RenderGlyph(char32_t c, Glyph& glyph) {
+  glyph.code = c;
+  glyph.found = false;
+  if (auto err = RenderUnicode(c, nihongo_face)) {
+    return err;
+  }
+
+  const FT_Bitmap& bitmap = nihongo_face->glyph->bitmap;
+  const int pitch = bitmap.pitch < 0 ? -bitmap.pitch : bitmap.pitch;
+  if (pitch * static_cast<int>(bitmap.rows) > Glyph::kMaxBitmapBytes) {
+    return MAKE_ERROR(Error::kFull);
+  }
+
+  const int baseline = (nihongo_face->height + nihongo_face->descender) *
+    nihongo_face->size->metrics.y_ppem / nihongo_face->units_per_EM;
+  glyph.found = true;
+  glyph.topleft = {nihongo_face->glyph->bitmap_left,
+                   baseline - nihongo_face->glyph->bitmap_top};
+  glyph.width = bitmap.width;
+  glyph.rows = bitmap.rows;
+  glyph.pitch = pitch;
+  for (int dy = 0; dy < glyph.rows; ++dy) {
+    const unsigned char* q = &bitmap.buffer[bitmap.pitch * dy];
+    if (bitmap.pitch < 0) {
+      q -= bitmap.pitch * bitmap.rows;
+    }
+    memcpy(&glyph.bitmap[pitch * dy], q, pitch);
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+/** @brief c のグリフをキャッシュから探し，無ければ描画して登録する。 */
+Error LoadGlyph(char32_t c, Glyph& glyph) {
+  // 面とキャッシュは全タスクで共有するので，割り込みを禁止して使う
+  const bool interrupts_enabled = DisableInterrupts();
+  Error err = MAKE_ERROR(Error::kSuccess);
+  if (!nihongo_face) {
+    err = MAKE_ERROR(Error::kNoSuchEntry);
+  } else if (auto cached = glyph_cache->Find(c)) {
+    glyph = *cached;
+  } else {
+    err = RenderGlyph(c, glyph);
+    if (err.Cause() != Error::kFull) {
+      glyph_cache->Insert(glyph);
+    }
+  }
+  if (interrupts_enabled) {
+    __asm__("sti");
+  }
+
+  if (!err && !glyph.found) {
+    return MAKE_ERROR(Error::kFreeTypeError);
+  }
+  return err;
+}
+
 } // namespace
 
 void WriteAscii(PixelWriter& writer, Vector2D<int> pos, char c, const PixelColor& color) {
@@ -50,17 +201,47 @@ void WriteAscii(PixelWriter& writer, Vector2D<int> pos, char c, const PixelColor
     return;
   }
   for (int dy = 0; dy < 16; ++dy) {
-    for (int dx = 0; dx < 8; ++dx) {
-      if ((font[dy] << dx) & 0x80u) {
-        writer.Write(pos + Vector2D<int>{dx, dy}, color);
+    writer.WriteMaskSpan(pos + Vector2D<int>{0, dy}, &font[dy], 8, color);
+  }
+}
+
+void WriteAsciiRun(PixelWriter& writer, Vector2D<int> pos,
+                   const char* s, int len, const PixelColor& color) {
+  // 1 文字 1 バイトのマスクを並べ，文字列の 1 行を 1 本のマスクにする
+  const int kMaxRun = 128;
+  uint8_t row_mask[kMaxRun];
+  const uint8_t* fonts[kMaxRun];
+  while (len > 0) {
+    const int n = std::min(len, kMaxRun);
+    for (int i = 0; i < n; ++i) {
+      fonts[i] = GetFont(s[i]);
+    }
+    for (int dy = 0; dy < 16; ++dy) {
+      for (int i = 0; i < n; ++i) {
+        row_mask[i] = fonts[i] ? fonts[i][dy] : 0;
       }
+      writer.WriteMaskSpan(pos + Vector2D<int>{0, dy}, row_mask, 8 * n, color);
     }
+    s += n;
+    len -= n;
+    pos.x += 8 * n;
   }
 }
 
 void WriteString(PixelWriter& writer, Vector2D<int> pos, const char* s, const PixelColor& color) {
   int x = 0;
   while (*s) {
+    int run = 0;
+    while (s[run] && CountUTF8Size(s[run]) == 1) {
+      ++run;
+    }
+    if (run > 0) {
+      WriteAsciiRun(writer, pos + Vector2D<int>{8 * x, 0}, s, run, color);
+      s += run;
+      x += run;
+      continue;
+    }
+
     const auto [ u32, bytes ] = ConvertUTF8To32(s);
     WriteUnicode(writer, pos + Vector2D<int>{8 * x, 0}, u32, color);
     s += bytes;
@@ -141,47 +322,35 @@ Error WriteUnicode(PixelWriter& writer, Vector2D<int> pos,
     return MAKE_ERROR(Error::kSuccess);
   }
 
-  auto [ face, err ] = NewFTFace();
-  if (err) {
+  Glyph glyph;
+  if (auto err = LoadGlyph(c, glyph)) {
     WriteAscii(writer, pos, '?', color);
     WriteAscii(writer, pos + Vector2D<int>{8, 0}, '?', color);
     return err;
   }
-  if (auto err = RenderUnicode(c, face)) {
-    FT_Done_Face(face);
-    WriteAscii(writer, pos, '?', color);
-    WriteAscii(writer, pos + Vector2D<int>{8, 0}, '?', color);
-    return err;
-  }
-  FT_Bitmap& bitmap = face->glyph->bitmap;
-
-  const int baseline = (face->height + face->descender) *
-    face->size->metrics.y_ppem / face->units_per_EM;
-  const auto glyph_topleft = pos + Vector2D<int>{
-    face->glyph->bitmap_left, baseline - face->glyph->bitmap_top};
 
-  for (int dy = 0; dy < bitmap.rows; ++dy) {
-    unsigned char* q = &bitmap.buffer[bitmap.pitch * dy];
-    if (bitmap.pitch < 0) {
-      q -= bitmap.pitch * bitmap.rows;
-    }
-    for (int dx = 0; dx < bitmap.width; ++dx) {
-      const bool b = q[dx >> 3] & (0x80 >> (dx & 0x7));
-      if (b) {
-        writer.Write(glyph_topleft + Vector2D<int>{dx, dy}, color);
-      }
-    }
+  for (int dy = 0; dy < glyph.rows; ++dy) {
+    writer.WriteMaskSpan(pos + glyph.topleft + Vector2D<int>{0, dy},
+                         &glyph.bitmap[glyph.pitch * dy], glyph.width, color);
   }
-
-  FT_Done_Face(face);
   return MAKE_ERROR(Error::kSuccess);
 }
 
+GlyphCacheStat GetGlyphCacheStat() {
+  const bool interrupts_enabled = DisableInterrupts();
+  const auto stat = glyph_cache->Stat();
+  if (interrupts_enabled) {
+    __asm__("sti");
+  }
+  return stat;
+}
+
 void InitializeFont() {
   if (int err = FT_Init_FreeType(&ft_library)) {
     Log(kError, "failed to initialize FreeType library\n");
     exit(1);
   }
+  glyph_cache = new GlyphCache;
 
   auto [ entry, pos_slash ] = fat::FindFile("/nihongo.ttf");
   if (entry == nullptr || pos_slash) {
@@ -196,4 +365,24 @@ void InitializeFont() {
     Log(kError, "failed to load nihongo.ttf");
     exit(1);
   }
+
+  auto [ face, err ] = NewFTFace();
+  if (err) {
+    Log(kError, "failed to open nihongo.ttf: %s\n", err.Name());
+    return;
+  }
+  nihongo_face = face;
+
+  // よく使う句読点・ひらがな・カタカナは先に描画しておく
+  const std::pair<char32_t, char32_t> kPrewarmRanges[] = {
+    {0x3001, 0x3002}, {0x3041, 0x3093}, {0x30a1, 0x30f6}, {0x30fc, 0x30fc},
+  };
+  Glyph glyph;
+  for (const auto& [ first, last ] : kPrewarmRanges) {
+    for (char32_t c = first; c <= last; ++c) {
+      if (RenderGlyph(c, glyph).Cause() != Error::kFull) {
+        glyph_cache->Insert(glyph);
+      }
+    }
+  }
 }
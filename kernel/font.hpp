@@ -11,6 +11,9 @@
 
 void WriteAscii(PixelWriter& writer, Vector2D<int> pos, char c, const PixelColor& color);
 void WriteString(PixelWriter& writer, Vector2D<int> pos, const char* s, const PixelColor& color);
+/** @brief ASCII 文字列 s[0..len) を 1 行分まとめて描く。各行を 1 回の WriteMaskSpan で描画する。 */
+void WriteAsciiRun(PixelWriter& writer, Vector2D<int> pos,
+                   const char* s, int len, const PixelColor& color);
 
 int CountUTF8Size(uint8_t c);
 std::pair<char32_t, int> ConvertUTF8To32(const char* u8);
@@ -19,3 +22,10 @@ WithError<FT_Face> NewFTFace();
 Error WriteUnicode(PixelWriter& writer, Vector2D<int> pos,
                    char32_t c, const PixelColor& color);
 void InitializeFont();
+
+/** @brief 非 ASCII 文字のグリフキャッシュの統計情報 */
+struct GlyphCacheStat {
+  unsigned long hits, misses, evictions;
+  size_t entries, capacity;
+};
+GlyphCacheStat GetGlyphCacheStat();
@@ -1,5 +1,7 @@
 #include "frame_buffer.hpp"
 
+#include "pixel_ops.hpp"
+
 namespace {
   int BytesPerPixel(PixelFormat format) {
     switch (format) {
@@ -35,11 +37,16 @@ Error FrameBuffer::Initialize(const FrameBufferConfig& config) {
   if (config_.frame_buffer) {
     buffer_.resize(0);
   } else {
+    const int pixels_per_line = kAlignment / bytes_per_pixel;
+    config_.pixels_per_scan_line =
+      (config_.horizontal_resolution + pixels_per_line - 1)
+      / pixels_per_line * pixels_per_line;
     buffer_.resize(
         bytes_per_pixel
-        * config_.horizontal_resolution * config_.vertical_resolution);
-    config_.frame_buffer = buffer_.data();
-    config_.pixels_per_scan_line = config_.horizontal_resolution;
+        * config_.pixels_per_scan_line * config_.vertical_resolution
+        + kAlignment - 1);
+    const auto addr = reinterpret_cast<uintptr_t>(buffer_.data());
+    config_.frame_buffer = buffer_.data() + (-addr & (kAlignment - 1));
   }
 
   switch (config_.pixel_format) {
@@ -76,8 +83,40 @@ Error FrameBuffer::Copy(Vector2D<int> dst_pos, const FrameBuffer& src,
   uint8_t* dst_buf = FrameAddrAt(copy_area.pos, config_);
   const uint8_t* src_buf = FrameAddrAt(src_start_pos, src.config_);
 
+  const auto copy = non_temporal_ ? StreamPixels : CopyPixels;
   for (int y = 0; y < copy_area.size.y; ++y) {
-    memcpy(dst_buf, src_buf, bytes_per_pixel * copy_area.size.x);
+    copy(dst_buf, src_buf, bytes_per_pixel * copy_area.size.x);
+    dst_buf += BytesPerScanLine(config_);
+    src_buf += BytesPerScanLine(src.config_);
+  }
+  if (non_temporal_) {
+    StreamFence();
+  }
+
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+Error FrameBuffer::Blend(Vector2D<int> dst_pos, const FrameBuffer& src,
+                         const Rectangle<int>& src_area) {
+  if (config_.pixel_format != src.config_.pixel_format) {
+    return MAKE_ERROR(Error::kUnknownPixelFormat);
+  }
+  if (BytesPerPixel(config_.pixel_format) != 4) {
+    return MAKE_ERROR(Error::kUnknownPixelFormat);
+  }
+
+  const Rectangle<int> src_area_shifted{dst_pos, src_area.size};
+  const Rectangle<int> src_outline{dst_pos - src_area.pos, FrameBufferSize(src.config_)};
+  const Rectangle<int> dst_outline{{0, 0}, FrameBufferSize(config_)};
+  const auto blend_area = dst_outline & src_outline & src_area_shifted;
+  const auto src_start_pos = blend_area.pos - (dst_pos - src_area.pos);
+
+  uint8_t* dst_buf = FrameAddrAt(blend_area.pos, config_);
+  const uint8_t* src_buf = FrameAddrAt(src_start_pos, src.config_);
+
+  for (int y = 0; y < blend_area.size.y; ++y) {
+    BlendPixels(reinterpret_cast<uint32_t*>(dst_buf),
+                reinterpret_cast<const uint32_t*>(src_buf), blend_area.size.x);
     dst_buf += BytesPerScanLine(config_);
     src_buf += BytesPerScanLine(src.config_);
   }
@@ -93,7 +132,7 @@ void FrameBuffer::Move(Vector2D<int> dst_pos, const Rectangle<int>& src) {
     uint8_t* dst_buf = FrameAddrAt(dst_pos, config_);
     const uint8_t* src_buf = FrameAddrAt(src.pos, config_);
     for (int y = 0; y < src.size.y; ++y) {
-      memcpy(dst_buf, src_buf, bytes_per_pixel * src.size.x);
+      CopyPixels(dst_buf, src_buf, bytes_per_pixel * src.size.x);
       dst_buf += bytes_per_scan_line;
       src_buf += bytes_per_scan_line;
     }
@@ -102,7 +141,7 @@ void FrameBuffer::Move(Vector2D<int> dst_pos, const Rectangle<int>& src) {
     const uint8_t* src_buf = FrameAddrAt(src.pos, config_);
     for (int y = 0; y < src.size.y; ++y) {
       // dst_buf and src_buf may overlap, we must use memmove
-      memmove(dst_buf, src_buf, bytes_per_pixel * src.size.x);
+      MovePixels(dst_buf, src_buf, bytes_per_pixel * src.size.x);
       dst_buf += bytes_per_scan_line;
       src_buf += bytes_per_scan_line;
     }
@@ -110,7 +149,7 @@ void FrameBuffer::Move(Vector2D<int> dst_pos, const Rectangle<int>& src) {
     uint8_t* dst_buf = FrameAddrAt(dst_pos + Vector2D<int>{0, src.size.y - 1}, config_);
     const uint8_t* src_buf = FrameAddrAt(src.pos + Vector2D<int>{0, src.size.y - 1}, config_);
     for (int y = 0; y < src.size.y; ++y) {
-      memcpy(dst_buf, src_buf, bytes_per_pixel * src.size.x);
+      CopyPixels(dst_buf, src_buf, bytes_per_pixel * src.size.x);
       dst_buf -= bytes_per_scan_line;
       src_buf -= bytes_per_scan_line;
     }
@@ -9,9 +9,24 @@
 
 class FrameBuffer {
  public:
+  /** @brief 自前で確保するバッファの先頭と各行の先頭をそろえる境界（キャッシュライン） */
+  static const int kAlignment = 64;
+
+  /** @brief config.frame_buffer が nullptr なら描画領域を自前で確保する。
+   *
+   * 自前で確保する場合，先頭は kAlignment 境界にそろえ，
+   * 1 行の画素数（pixels_per_scan_line）も kAlignment バイトの倍数に切り上げる。
+   */
   Error Initialize(const FrameBufferConfig& config);
   Error Copy(Vector2D<int> dst_pos, const FrameBuffer& src, const Rectangle<int>& src_area);
   void Move(Vector2D<int> dst_pos, const Rectangle<int>& src);
+  /** @brief src の各画素の最上位バイトを不透明度として，この描画領域に合成する。
+   *
+   * 引数の意味は Copy と同じ。
+   */
+  Error Blend(Vector2D<int> dst_pos, const FrameBuffer& src, const Rectangle<int>& src_area);
+  /** @brief true にすると Copy がキャッシュを経由しない書き込みを使う。実フレームバッファ向け。 */
+  void SetNonTemporal(bool non_temporal) { non_temporal_ = non_temporal; }
 
   FrameBufferWriter& Writer() { return *writer_; }
   const FrameBufferConfig& Config() const { return config_; }
@@ -20,4 +35,5 @@ class FrameBuffer {
   FrameBufferConfig config_{};
   std::vector<uint8_t> buffer_{};
   std::unique_ptr<FrameBufferWriter> writer_{};
+  bool non_temporal_{false};
 };
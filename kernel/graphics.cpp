@@ -6,6 +6,82 @@
 
 #include "graphics.hpp"
 
+#include "pixel_ops.hpp"
+
+void PixelWriter::FillRect(const Vector2D<int>& pos, const Vector2D<int>& size,
+                           const PixelColor& c) {
+  for (int dy = 0; dy < size.y; ++dy) {
+    FillSpan(pos + Vector2D<int>{0, dy}, size.x, c);
+  }
+}
+
+void PixelWriter::FillSpan(Vector2D<int> pos, int len, const PixelColor& c) {
+  int skip;
+  if (!ClipSpan(pos, len, skip)) {
+    return;
+  }
+  for (int i = 0; i < len; ++i) {
+    Write(pos + Vector2D<int>{i, 0}, c);
+  }
+}
+
+void PixelWriter::WriteSpan(Vector2D<int> pos, const PixelColor* colors, int len) {
+  int skip;
+  if (!ClipSpan(pos, len, skip)) {
+    return;
+  }
+  for (int i = 0; i < len; ++i) {
+    Write(pos + Vector2D<int>{i, 0}, colors[skip + i]);
+  }
+}
+
+void PixelWriter::WriteMaskSpan(Vector2D<int> pos, const uint8_t* mask, int len,
+                                const PixelColor& c) {
+  int skip;
+  if (!ClipSpan(pos, len, skip)) {
+    return;
+  }
+  for (int i = 0; i < len; ++i) {
+    const int bit = skip + i;
+    if (mask[bit >> 3] & (0x80u >> (bit & 7))) {
+      Write(pos + Vector2D<int>{i, 0}, c);
+    }
+  }
+}
+
+bool PixelWriter::ClipSpan(Vector2D<int>& pos, int& len, int& skip) const {
+  if (pos.y < 0 || Height() <= pos.y) {
+    return false;
+  }
+  skip = pos.x < 0 ? -pos.x : 0;
+  pos.x += skip;
+  len = std::min(len - skip, Width() - pos.x);
+  return len > 0;
+}
+
+void FrameBufferWriter::FillRectPacked(const Vector2D<int>& pos,
+                                       const Vector2D<int>& size,
+                                       uint32_t value) {
+  const Rectangle<int> writer_area{{0, 0}, {Width(), Height()}};
+  const auto area = Rectangle<int>{pos, size} & writer_area;
+  if (area.size.x <= 0) {
+    return;
+  }
+  for (int y = area.pos.y; y < area.pos.y + area.size.y; ++y) {
+    FillPixels32(reinterpret_cast<uint32_t*>(PixelAt({area.pos.x, y})),
+                 value, area.size.x);
+  }
+}
+
+void FrameBufferWriter::WriteMaskSpanPacked(
+    Vector2D<int> pos, const uint8_t* mask, int len, uint32_t value) {
+  int skip;
+  if (!ClipSpan(pos, len, skip)) {
+    return;
+  }
+  MaskFillPixels32(reinterpret_cast<uint32_t*>(PixelAt(pos)), mask, skip, len, value);
+}
+
 void RGBResv8BitPerColorPixelWriter::Write(Vector2D<int> pos, const PixelColor& c) {
   auto p = PixelAt(pos);
   p[0] = c.r;
@@ -13,6 +89,26 @@ void RGBResv8BitPerColorPixelWriter::Write(Vector2D<int> pos, const PixelColor&
   p[2] = c.b;
 }
 
+void RGBResv8BitPerColorPixelWriter::FillRect(
+    const Vector2D<int>& pos, const Vector2D<int>& size, const PixelColor& c) {
+  FillRectPacked(pos, size, Pack(c));
+}
+
+void RGBResv8BitPerColorPixelWriter::FillSpan(
+    Vector2D<int> pos, int len, const PixelColor& c) {
+  FillRectPacked(pos, {len, 1}, Pack(c));
+}
+
+void RGBResv8BitPerColorPixelWriter::WriteSpan(
+    Vector2D<int> pos, const PixelColor* colors, int len) {
+  WriteSpanPacked(pos, colors, len, Pack);
+}
+
+void RGBResv8BitPerColorPixelWriter::WriteMaskSpan(
+    Vector2D<int> pos, const uint8_t* mask, int len, const PixelColor& c) {
+  WriteMaskSpanPacked(pos, mask, len, Pack(c));
+}
+
 void BGRResv8BitPerColorPixelWriter::Write(Vector2D<int> pos, const PixelColor& c) {
   auto p = PixelAt(pos);
   p[0] = c.b;
@@ -20,12 +116,30 @@ void BGRResv8BitPerColorPixelWriter::Write(Vector2D<int> pos, const PixelColor&
   p[2] = c.r;
 }
 
+void BGRResv8BitPerColorPixelWriter::FillRect(
+    const Vector2D<int>& pos, const Vector2D<int>& size, const PixelColor& c) {
+  FillRectPacked(pos, size, Pack(c));
+}
+
+void BGRResv8BitPerColorPixelWriter::FillSpan(
+    Vector2D<int> pos, int len, const PixelColor& c) {
+  FillRectPacked(pos, {len, 1}, Pack(c));
+}
+
+void BGRResv8BitPerColorPixelWriter::WriteSpan(
+    Vector2D<int> pos, const PixelColor* colors, int len) {
+  WriteSpanPacked(pos, colors, len, Pack);
+}
+
+void BGRResv8BitPerColorPixelWriter::WriteMaskSpan(
+    Vector2D<int> pos, const uint8_t* mask, int len, const PixelColor& c) {
+  WriteMaskSpanPacked(pos, mask, len, Pack(c));
+}
+
 void DrawRectangle(PixelWriter& writer, const Vector2D<int>& pos,
                    const Vector2D<int>& size, const PixelColor& c) {
-  for (int dx = 0; dx < size.x; ++dx) {
-    writer.Write(pos + Vector2D<int>{dx, 0}, c);
-    writer.Write(pos + Vector2D<int>{dx, size.y - 1}, c);
-  }
+  writer.FillSpan(pos, size.x, c);
+  writer.FillSpan(pos + Vector2D<int>{0, size.y - 1}, size.x, c);
   for (int dy = 1; dy < size.y - 1; ++dy) {
     writer.Write(pos + Vector2D<int>{0, dy}, c);
     writer.Write(pos + Vector2D<int>{size.x - 1, dy}, c);
@@ -34,11 +148,7 @@ void DrawRectangle(PixelWriter& writer, const Vector2D<int>& pos,
 
 void FillRectangle(PixelWriter& writer, const Vector2D<int>& pos,
                    const Vector2D<int>& size, const PixelColor& c) {
-  for (int dy = 0; dy < size.y; ++dy) {
-    for (int dx = 0; dx < size.x; ++dx) {
-      writer.Write(pos + Vector2D<int>{dx, dy}, c);
-    }
-  }
+  writer.FillRect(pos, size, c);
 }
 
 void DrawDesktop(PixelWriter& writer) {
@@ -92,6 +92,31 @@ class PixelWriter {
   virtual void Write(Vector2D<int> pos, const PixelColor& c) = 0;
   virtual int Width() const = 0;
   virtual int Height() const = 0;
+  /** @brief 矩形を塗りつぶす。既定の実装は 1 行ずつ FillSpan を呼ぶ。 */
+  virtual void FillRect(const Vector2D<int>& pos, const Vector2D<int>& size,
+                        const PixelColor& c);
+
+  /* 以下の行単位の描画は，描画先からはみ出す部分を無視する。
+   * 既定の実装は 1 画素ずつ Write を呼ぶので，派生クラスで高速な実装に置き換える。 */
+
+  /** @brief pos から右へ len 画素を c で塗る。 */
+  virtual void FillSpan(Vector2D<int> pos, int len, const PixelColor& c);
+  /** @brief pos から右へ colors[0] から colors[len - 1] を書く。 */
+  virtual void WriteSpan(Vector2D<int> pos, const PixelColor* colors, int len);
+  /** @brief pos から右へ len 画素のうち，mask のビットが 1 の画素だけを c で塗る。
+   *
+   * mask は 1 画素 1 ビットで，各バイトの最上位ビットが左端の画素に対応する。
+   */
+  virtual void WriteMaskSpan(Vector2D<int> pos, const uint8_t* mask, int len,
+                             const PixelColor& c);
+
+ protected:
+  /** @brief 行 pos.y の [pos.x, pos.x + len) を描画先の範囲に切り詰める。
+   *
+   * @param skip  左側で切り捨てた画素数
+   * @return 描画すべき画素が残っていれば true
+   */
+  bool ClipSpan(Vector2D<int>& pos, int& len, int& skip) const;
 };
 
 class FrameBufferWriter : public PixelWriter {
@@ -106,6 +131,25 @@ class FrameBufferWriter : public PixelWriter {
   uint8_t* PixelAt(Vector2D<int> pos) {
     return config_.frame_buffer + 4 * (config_.pixels_per_scan_line * pos.y + pos.x);
   }
+  /** @brief 画面内に切り詰めた矩形を 4 バイトの画素値 value で塗りつぶす。 */
+  void FillRectPacked(const Vector2D<int>& pos, const Vector2D<int>& size,
+                      uint32_t value);
+
+  template <class Pack>
+  void WriteSpanPacked(Vector2D<int> pos, const PixelColor* colors, int len,
+                       Pack pack) {
+    int skip;
+    if (!ClipSpan(pos, len, skip)) {
+      return;
+    }
+    auto p = reinterpret_cast<uint32_t*>(PixelAt(pos));
+    for (int i = 0; i < len; ++i) {
+      p[i] = pack(colors[skip + i]);
+    }
+  }
+
+  void WriteMaskSpanPacked(Vector2D<int> pos, const uint8_t* mask, int len,
+                           uint32_t value);
 
  private:
   const FrameBufferConfig& config_;
@@ -115,12 +159,46 @@ class RGBResv8BitPerColorPixelWriter : public FrameBufferWriter {
  public:
   using FrameBufferWriter::FrameBufferWriter;
   virtual void Write(Vector2D<int> pos, const PixelColor& c) override;
+  virtual void FillRect(const Vector2D<int>& pos, const Vector2D<int>& size,
+                        const PixelColor& c) override;
+  virtual void FillSpan(Vector2D<int> pos, int len, const PixelColor& c) override;
+  virtual void WriteSpan(Vector2D<int> pos, const PixelColor* colors,
+                         int len) override;
+  virtual void WriteMaskSpan(Vector2D<int> pos, const uint8_t* mask, int len,
+                             const PixelColor& c) override;
+
+  /** @brief 色をこの形式の 4 バイトの画素値に変換する。 */
+  static uint32_t Pack(const PixelColor& c) {
+    return c.r | c.g << 8 | c.b << 16;
+  }
+  /** @brief この形式の画素値を色に戻す。 */
+  static PixelColor Unpack(uint32_t v) {
+    return {static_cast<uint8_t>(v), static_cast<uint8_t>(v >> 8),
+            static_cast<uint8_t>(v >> 16)};
+  }
 };
 
 class BGRResv8BitPerColorPixelWriter : public FrameBufferWriter {
  public:
   using FrameBufferWriter::FrameBufferWriter;
   virtual void Write(Vector2D<int> pos, const PixelColor& c) override;
+  virtual void FillRect(const Vector2D<int>& pos, const Vector2D<int>& size,
+                        const PixelColor& c) override;
+  virtual void FillSpan(Vector2D<int> pos, int len, const PixelColor& c) override;
+  virtual void WriteSpan(Vector2D<int> pos, const PixelColor* colors,
+                         int len) override;
+  virtual void WriteMaskSpan(Vector2D<int> pos, const uint8_t* mask, int len,
+                             const PixelColor& c) override;
+
+  /** @brief 色をこの形式の 4 バイトの画素値に変換する。 */
+  static uint32_t Pack(const PixelColor& c) {
+    return c.b | c.g << 8 | c.r << 16;
+  }
+  /** @brief この形式の画素値を色に戻す。 */
+  static PixelColor Unpack(uint32_t v) {
+    return {static_cast<uint8_t>(v >> 16), static_cast<uint8_t>(v >> 8),
+            static_cast<uint8_t>(v)};
+  }
 };
 
 void DrawRectangle(PixelWriter& writer, const Vector2D<int>& pos,
@@ -74,4 +74,14 @@ struct InterruptFrame {
 
 void NotifyEndOfInterrupt();
 
+/** @brief 割り込みを禁止し，禁止する前に許可されていたなら true を返す。
+ *
+ * 割り込み禁止中にも許可中にも呼ばれる処理で使う。true が返ったら処理の後に sti する。
+ */
+inline bool DisableInterrupts() {
+  uint64_t rflags;
+  __asm__ volatile("pushfq; pop %0; cli" : "=r"(rflags) : : "memory");
+  return rflags & 0x200;
+}
+
 void InitializeInterrupt();
@@ -1,7 +1,9 @@
 #include "layer.hpp"
 
 #include <algorithm>
+#include <limits>
 #include "console.hpp"
+#include "interrupt.hpp"
 #include "logger.hpp"
 #include "task.hpp"
 
@@ -65,11 +67,22 @@ void LayerManager::SetWriter(FrameBuffer* screen) {
   FrameBufferConfig back_config = screen->Config();
   back_config.frame_buffer = nullptr;
   back_buffer_.Initialize(back_config);
+
+  const int cell = 1 << kGridCellShift;
+  grid_columns_ = (back_config.horizontal_resolution + cell - 1) >> kGridCellShift;
+  grid_rows_ = (back_config.vertical_resolution + cell - 1) >> kGridCellShift;
+  grid_.resize(grid_columns_ * grid_rows_);
+  grid_dirty_ = true;
 }
 
 Layer& LayerManager::NewLayer() {
   ++latest_id_;
-  return *layers_.emplace_back(new Layer{latest_id_});
+  auto& layer = *layers_.emplace_back(new Layer{latest_id_});
+  if (layer_by_id_.size() <= latest_id_) {
+    layer_by_id_.resize(latest_id_ + 1);
+  }
+  layer_by_id_[latest_id_] = &layer;
+  return layer;
 }
 
 void LayerManager::RemoveLayer(unsigned int id) {
@@ -79,13 +92,88 @@ void LayerManager::RemoveLayer(unsigned int id) {
     return elem->ID() == id;
   };
   EraseIf(layers_, pred);
+  if (id < layer_by_id_.size()) {
+    layer_by_id_[id] = nullptr;
+  }
 }
 
 void LayerManager::Draw(const Rectangle<int>& area) const {
-  for (auto layer : layer_stack_) {
-    layer->DrawTo(back_buffer_, area);
+  if (deferred_) {
+    // 割り込み禁止中にも，許可中にも呼ばれる
+    const bool interrupts_enabled = DisableInterrupts();
+    pending_.Add(area);
+    if (interrupts_enabled) {
+      __asm__("sti");
+    }
+    return;
   }
+
+  Compose(area);
+  CopyToScreen(area);
+}
+
+void LayerManager::SetCursor(const std::shared_ptr<Window>& cursor,
+                             Vector2D<int> pos) {
+  cursor_ = cursor;
+  cursor_pos_ = pos;
+  if (cursor_) {
+    CopyToScreen({pos, cursor_->Size()});
+  }
+}
+
+void LayerManager::MoveCursor(Vector2D<int> pos) {
+  if (!cursor_) {
+    return;
+  }
+
+  // 画面への書き込みが Flush と入れ違わないよう割り込みを禁止する
+  const bool interrupts_enabled = DisableInterrupts();
+  const Rectangle<int> old_area{cursor_pos_, cursor_->Size()};
+  cursor_pos_ = pos;
+  screen_->Copy(old_area.pos, back_buffer_, old_area);
+  cursor_->DrawTo(*screen_, cursor_pos_, {cursor_pos_, cursor_->Size()});
+  if (interrupts_enabled) {
+    __asm__("sti");
+  }
+}
+
+void LayerManager::CopyToScreen(const Rectangle<int>& area) const {
   screen_->Copy(area.pos, back_buffer_, area);
+  if (!cursor_) {
+    return;
+  }
+  const auto cursor_area = area & Rectangle<int>{cursor_pos_, cursor_->Size()};
+  if (cursor_area.size.x > 0 && cursor_area.size.y > 0) {
+    cursor_->DrawTo(*screen_, cursor_pos_, cursor_area);
+  }
+}
+
+size_t LayerManager::Flush() {
+  __asm__("cli");
+  flushing_ = pending_;
+  flushing_copy_ = pending_copy_;
+  pending_.Clear();
+  pending_copy_.Clear();
+  __asm__("sti");
+
+  // 描画中にレイヤーが削除されないよう，矩形 1 つずつ割り込みを禁止して合成する
+  for (const auto& area : flushing_.Rects()) {
+    __asm__("cli");
+    Compose(area);
+    CopyToScreen(area);
+    __asm__("sti");
+  }
+  for (const auto& area : flushing_copy_.Rects()) {
+    __asm__("cli");
+    CopyToScreen(area);
+    __asm__("sti");
+  }
+  const auto num_rects = flushing_.Rects().size() + flushing_copy_.Rects().size();
+  __asm__("cli");
+  flushing_.Clear();
+  flushing_copy_.Clear();
+  __asm__("sti");
+  return num_rects;
 }
 
 void LayerManager::Draw(unsigned int id) const {
@@ -93,41 +181,178 @@ void LayerManager::Draw(unsigned int id) const {
 }
 
 void LayerManager::Draw(unsigned int id, Rectangle<int> area) const {
-  bool draw = false;
-  Rectangle<int> window_area;
   for (auto layer : layer_stack_) {
-    if (layer->ID() == id) {
-      window_area.size = layer->GetWindow()->Size();
-      window_area.pos = layer->GetPosition();
-      if (area.size.x >= 0 || area.size.y >= 0) {
-        area.pos = area.pos + window_area.pos;
-        window_area = window_area & area;
+    if (layer->ID() != id) {
+      continue;
+    }
+    Rectangle<int> window_area{layer->GetPosition(), layer->GetWindow()->Size()};
+    if (area.size.x >= 0 || area.size.y >= 0) {
+      area.pos = area.pos + window_area.pos;
+      window_area = window_area & area;
+    }
+    Draw(window_area);
+    return;
+  }
+}
+
+void LayerManager::Compose(const Rectangle<int>& area) const {
+  // 上のレイヤーから順に，まだ不透明なレイヤーに覆われていない範囲のうち
+  // 自分と重なる部分を描画予定に積み，不透明なら自分の範囲を未被覆範囲から除く
+  paint_queue_.clear();
+  uncovered_.clear();
+  if (area.size.x > 0 && area.size.y > 0) {
+    uncovered_.push_back(area);
+  }
+
+  for (auto it = layer_stack_.rbegin();
+       it != layer_stack_.rend() && !uncovered_.empty();
+       ++it) {
+    const Layer* layer = *it;
+    const auto window = layer->GetWindow();
+    if (!window) {
+      continue;
+    }
+
+    const Rectangle<int> layer_area{layer->GetPosition(), window->Size()};
+    for (const auto& r : uncovered_) {
+      const auto visible = r & layer_area;
+      if (visible.size.x > 0 && visible.size.y > 0) {
+        paint_queue_.push_back({layer, visible});
       }
-      draw = true;
     }
-    if (draw) {
-      layer->DrawTo(back_buffer_, window_area);
+
+    if (window->IsOpaque()) {
+      uncovered_next_.clear();
+      for (const auto& r : uncovered_) {
+        SubtractRect(r, layer_area, uncovered_next_);
+      }
+      uncovered_.swap(uncovered_next_);
     }
   }
-  screen_->Copy(window_area.pos, back_buffer_, window_area);
+
+  // 透過レイヤーが下のレイヤーの上に重なるよう，下から順に描画する
+  for (auto it = paint_queue_.rbegin(); it != paint_queue_.rend(); ++it) {
+    it->first->DrawTo(back_buffer_, it->second);
+  }
+}
+
+void LayerManager::Draw(unsigned int id, const DamageList& damage) const {
+  for (const auto& area : damage.Rects()) {
+    Draw(id, area);
+  }
 }
 
 void LayerManager::Move(unsigned int id, Vector2D<int> new_pos) {
-  auto layer = FindLayer(id);
-  const auto window_size = layer->GetWindow()->Size();
-  const auto old_pos = layer->GetPosition();
-  layer->Move(new_pos);
-  Draw({old_pos, window_size});
-  Draw(id);
+  MoveLayer(*FindLayer(id), new_pos);
 }
 
 void LayerManager::MoveRelative(unsigned int id, Vector2D<int> pos_diff) {
   auto layer = FindLayer(id);
-  const auto window_size = layer->GetWindow()->Size();
-  const auto old_pos = layer->GetPosition();
-  layer->MoveRelative(pos_diff);
+  MoveLayer(*layer, layer->GetPosition() + pos_diff);
+}
+
+void LayerManager::MoveLayer(Layer& layer, Vector2D<int> new_pos) {
+  const auto window_size = layer.GetWindow()->Size();
+  const auto old_pos = layer.GetPosition();
+  if (new_pos.x == old_pos.x && new_pos.y == old_pos.y) {
+    Draw(layer.ID());
+    return;
+  }
+
+  // Flush と並行して back_buffer_ を書き換えないよう割り込みを禁止する
+  const bool interrupts_enabled = DisableInterrupts();
+  const bool scrolled = ScrollLayer(layer, new_pos);
+  if (interrupts_enabled) {
+    __asm__("sti");
+  }
+  if (scrolled) {
+    return;
+  }
+
+  layer.Move(new_pos);
+  grid_dirty_ = true;
   Draw({old_pos, window_size});
-  Draw(id);
+  Draw(layer.ID());
+}
+
+bool LayerManager::ScrollLayer(Layer& layer, Vector2D<int> new_pos) {
+  const auto window = layer.GetWindow();
+  if (!window->IsOpaque()) {
+    return false;
+  }
+  auto it = std::find(layer_stack_.begin(), layer_stack_.end(), &layer);
+  if (it == layer_stack_.end()) {
+    return false;
+  }
+
+  const auto diff = new_pos - layer.GetPosition();
+  const Rectangle<int> old_area{layer.GetPosition(), window->Size()};
+  const Rectangle<int> new_area{new_pos, window->Size()};
+
+  // 上のレイヤー（マウスカーソルなど）は移動後に描き直す。広すぎるなら流用しない
+  int above_pixels = 0;
+  for (auto above = it + 1; above != layer_stack_.end(); ++above) {
+    if (auto w = (*above)->GetWindow()) {
+      above_pixels += w->Width() * w->Height();
+    }
+  }
+  if (above_pixels >= window->Width() * window->Height()) {
+    return false;
+  }
+
+  // 画面内にあって，移動前も画面内だった部分だけを back_buffer_ 上で移動する
+  const auto& config = back_buffer_.Config();
+  const Rectangle<int> screen_area{
+    {0, 0},
+    {static_cast<int>(config.horizontal_resolution),
+     static_cast<int>(config.vertical_resolution)}};
+  const auto dst = new_area & screen_area & Rectangle<int>{diff, screen_area.size};
+  if (dst.size.x <= 0 || dst.size.y <= 0) {
+    return false;
+  }
+  const Rectangle<int> src{dst.pos - diff, dst.size};
+  back_buffer_.Move(dst.pos, src);
+  layer.Move(new_pos);
+  grid_dirty_ = true;
+
+  DamageList damage;
+  std::vector<Rectangle<int>> exposed;
+  SubtractRect(old_area, dst, exposed);
+  SubtractRect(new_area, dst, exposed);
+  for (const auto& r : exposed) {
+    damage.Add(r);
+  }
+  for (auto above = it + 1; above != layer_stack_.end(); ++above) {
+    if (auto w = (*above)->GetWindow()) {
+      const Rectangle<int> above_area{(*above)->GetPosition(), w->Size()};
+      const auto ghost = above_area & src;
+      damage.Add({ghost.pos + diff, ghost.size});
+      damage.Add(above_area);
+    }
+  }
+  // 合成待ちの範囲は，移動した画素が古いままなので移動先でも合成し直す
+  for (const auto list : {&pending_, &flushing_}) {
+    for (const auto& r : list->Rects()) {
+      const auto moved = r & src;
+      damage.Add({moved.pos + diff, moved.size});
+    }
+  }
+
+  if (deferred_) {
+    for (const auto& r : damage.Rects()) {
+      pending_.Add(r);
+    }
+    pending_copy_.Add(dst);
+    return true;
+  }
+  for (const auto& r : damage.Rects()) {
+    Compose(r);
+  }
+  CopyToScreen(dst);
+  for (const auto& r : damage.Rects()) {
+    CopyToScreen(r);
+  }
+  return true;
 }
 
 void LayerManager::UpDown(unsigned int id, int new_height) {
@@ -139,6 +364,7 @@ void LayerManager::UpDown(unsigned int id, int new_height) {
     new_height = layer_stack_.size();
   }
 
+  grid_dirty_ = true;
   auto layer = FindLayer(id);
   auto old_pos = std::find(layer_stack_.begin(), layer_stack_.end(), layer);
   auto new_pos = layer_stack_.begin() + new_height;
@@ -156,6 +382,7 @@ void LayerManager::UpDown(unsigned int id, int new_height) {
 }
 
 void LayerManager::Hide(unsigned int id) {
+  grid_dirty_ = true;
   auto layer = FindLayer(id);
   auto pos = std::find(layer_stack_.begin(), layer_stack_.end(), layer);
   if (pos != layer_stack_.end()) {
@@ -163,7 +390,71 @@ void LayerManager::Hide(unsigned int id) {
   }
 }
 
+void LayerManager::RebuildGrid() const {
+  grid_dirty_ = false;
+  for (auto& cell : grid_) {
+    cell.clear();
+  }
+
+  const int cell_size = 1 << kGridCellShift;
+  for (auto it = layer_stack_.rbegin(); it != layer_stack_.rend(); ++it) {
+    Layer* layer = *it;
+    const auto win = layer->GetWindow();
+    if (!win) {
+      continue;
+    }
+    const auto begin = layer->GetPosition();
+    const auto end = begin + win->Size();
+    const int cx_begin = std::max(begin.x, 0) >> kGridCellShift;
+    const int cy_begin = std::max(begin.y, 0) >> kGridCellShift;
+    const int cx_end = std::min((end.x + cell_size - 1) >> kGridCellShift, grid_columns_);
+    const int cy_end = std::min((end.y + cell_size - 1) >> kGridCellShift, grid_rows_);
+    for (int cy = cy_begin; cy < cy_end; ++cy) {
+      for (int cx = cx_begin; cx < cx_end; ++cx) {
+        auto& cell = grid_[cy * grid_columns_ + cx];
+        // マスを覆い尽くすレイヤーが既にあれば，それより下は当たらない
+        if (!cell.empty() && cell.back() == nullptr) {
+          continue;
+        }
+        cell.push_back(layer);
+        const int x = cx << kGridCellShift, y = cy << kGridCellShift;
+        if (begin.x <= x && x + cell_size <= end.x &&
+            begin.y <= y && y + cell_size <= end.y) {
+          cell.push_back(nullptr); // 番兵
+        }
+      }
+    }
+  }
+}
+
 Layer* LayerManager::FindLayerByPosition(Vector2D<int> pos, unsigned int exclude_id) const {
+  const int cx = pos.x >> kGridCellShift, cy = pos.y >> kGridCellShift;
+  if (exclude_id == 0 && 0 <= pos.x && cx < grid_columns_ &&
+      0 <= pos.y && cy < grid_rows_) {
+    const bool interrupts_enabled = DisableInterrupts();
+    if (grid_dirty_) {
+      RebuildGrid();
+    }
+    Layer* found = nullptr;
+    for (Layer* layer : grid_[cy * grid_columns_ + cx]) {
+      if (layer == nullptr) {
+        break;
+      }
+      const auto win_pos = layer->GetPosition();
+      const auto win_end_pos = win_pos + layer->GetWindow()->Size();
+      if (win_pos.x <= pos.x && pos.x < win_end_pos.x &&
+          win_pos.y <= pos.y && pos.y < win_end_pos.y) {
+        found = layer;
+        break;
+      }
+    }
+    if (interrupts_enabled) {
+      __asm__("sti");
+    }
+    return found;
+  }
+
+  // 画面外の座標や，除外するレイヤーがある場合は重なり順に調べる
   auto pred = [pos, exclude_id](Layer* layer) {
     if (layer->ID() == exclude_id) {
       return false;
@@ -185,14 +476,10 @@ Layer* LayerManager::FindLayerByPosition(Vector2D<int> pos, unsigned int exclude
 }
 
 Layer* LayerManager::FindLayer(unsigned int id) {
-  auto pred = [id](const std::unique_ptr<Layer>& elem) {
-    return elem->ID() == id;
-  };
-  auto it = std::find_if(layers_.begin(), layers_.end(), pred);
-  if (it == layers_.end()) {
+  if (id >= layer_by_id_.size()) {
     return nullptr;
   }
-  return it->get();
+  return layer_by_id_[id];
 }
 
 int LayerManager::GetHeight(unsigned int id) {
@@ -224,10 +511,6 @@ LayerManager* layer_manager;
 ActiveLayer::ActiveLayer(LayerManager& manager) : manager_{manager} {
 }
 
-void ActiveLayer::SetMouseLayer(unsigned int mouse_layer) {
-  mouse_layer_ = mouse_layer;
-}
-
 void ActiveLayer::Activate(unsigned int layer_id) {
   if (active_layer_ == layer_id) {
     return;
@@ -244,8 +527,7 @@ void ActiveLayer::Activate(unsigned int layer_id) {
   if (active_layer_ > 0) {
     Layer* layer = manager_.FindLayer(active_layer_);
     layer->GetWindow()->Activate();
-    manager_.UpDown(active_layer_, 0);
-    manager_.UpDown(active_layer_, manager_.GetHeight(mouse_layer_) - 1);
+    manager_.UpDown(active_layer_, std::numeric_limits<int>::max());
     manager_.Draw(active_layer_);
     SendWindowActiveMessage(active_layer_, 1);
   }
@@ -271,6 +553,7 @@ void InitializeLayer() {
         err.Name(), err.File(), err.Line());
     exit(1);
   }
+  screen->SetNonTemporal(true);
 
   layer_manager = new LayerManager;
   layer_manager->SetWriter(screen);
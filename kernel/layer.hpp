@@ -13,6 +13,7 @@
 #include "graphics.hpp"
 #include "window.hpp"
 #include "message.hpp"
+#include "damage.hpp"
 
 /** @brief Layer は 1 つの層を表す。
  *
@@ -65,12 +66,18 @@ class LayerManager {
   /** @brief 指定されたレイヤーを削除する。 */
   void RemoveLayer(unsigned int id);
 
-  /** @brief 現在表示状態にあるレイヤーを描画する。 */
+  /** @brief 現在表示状態にあるレイヤーを描画する。
+   *
+   * 不透明なレイヤーに覆われた部分は，その下のレイヤーを描画しない。
+   * 遅延描画中は描画せず，範囲を記録するだけにする（以下の Draw も同様）。
+   */
   void Draw(const Rectangle<int>& area) const;
   /** @brief 指定したレイヤーに設定されているウィンドウの描画領域内を再描画する。 */
   void Draw(unsigned int id) const;
   /** @brief 指定したレイヤーに設定されているウィンドウ内の指定された範囲を再描画する。 */
   void Draw(unsigned int id, Rectangle<int> area) const;
+  /** @brief 指定したレイヤーのウィンドウ内で damage に含まれる範囲だけを再描画する。 */
+  void Draw(unsigned int id, const DamageList& damage) const;
 
   /** @brief レイヤーの位置情報を指定された絶対座標へと更新する。再描画する。 */
   void Move(unsigned int id, Vector2D<int> new_pos);
@@ -87,19 +94,78 @@ class LayerManager {
   /** @brief レイヤーを非表示とする。 */
   void Hide(unsigned int id);
 
-  /** @brief 指定された座標にウィンドウを持つ最も上に表示されているレイヤーを探す。 */
+  /** @brief 指定された座標にウィンドウを持つ最も上に表示されているレイヤーを探す。
+   *
+   * 画面を格子に区切り，各マスに重なる表示中のレイヤーの一覧（索引）を引く。
+   * 索引はレイヤーの移動や重なり順の変更の後，最初の呼び出しで作り直す。
+   * 表示中のレイヤーを Layer::Move で直接動かした場合は索引に反映されないので，
+   * LayerManager::Move を使うこと。
+   */
   Layer* FindLayerByPosition(Vector2D<int> pos, unsigned int exclude_id) const;
   /** @brief 指定された ID を持つレイヤーを返す。 */
   Layer* FindLayer(unsigned int id);
   /** @brief 指定されたレイヤーの現在の高さを返す。 */
   int GetHeight(unsigned int id);
 
+  /** @brief true にすると遅延描画となり，Draw 系メソッドは再描画範囲を記録するだけになる。
+   *
+   * 記録した範囲は Flush でまとめて描画する。コンポジタタスクが開始時に有効にする。
+   */
+  void SetDeferred(bool deferred) { deferred_ = deferred; }
+  /** @brief 記録した再描画範囲を描画し，描画した矩形の数を返す。 */
+  size_t Flush();
+
+  /** @brief マウスカーソルとして，全レイヤーの上に重ねて画面へ直接描くウィンドウを設定する。
+   *
+   * カーソルはバックバッファには描かない。バックバッファがカーソルの下の画面内容
+   * （セーブアンダー）を保持するので，カーソルの移動や下の内容の更新で
+   * レイヤーを合成し直す必要はない。
+   */
+  void SetCursor(const std::shared_ptr<Window>& cursor, Vector2D<int> pos);
+  /** @brief カーソルを移動する。旧位置をバックバッファから復元し，新位置に描く。 */
+  void MoveCursor(Vector2D<int> pos);
+
  private:
   FrameBuffer* screen_{nullptr};
   mutable FrameBuffer back_buffer_{};
   std::vector<std::unique_ptr<Layer>> layers_{};
   std::vector<Layer*> layer_stack_{};
   unsigned int latest_id_{0};
+  /** @brief ID からレイヤーを引く表。削除されたレイヤーの要素は nullptr */
+  std::vector<Layer*> layer_by_id_{};
+
+  /** @brief 位置の索引の 1 マスの大きさ（2 のべき乗の指数） */
+  static const int kGridCellShift = 6;
+  /** @brief 各マスに重なる表示中のレイヤー（上から順）。マスを覆い尽くすレイヤーより下は含めない */
+  mutable std::vector<std::vector<Layer*>> grid_{};
+  mutable int grid_columns_{0}, grid_rows_{0};
+  mutable bool grid_dirty_{true};
+  void RebuildGrid() const;
+
+  /** @brief area の範囲を，各画素を覆う不透明レイヤーとそれより上のレイヤーだけで back_buffer_ に合成する。 */
+  void Compose(const Rectangle<int>& area) const;
+  /** @brief レイヤーを移動して再描画する。可能なら ScrollLayer で描画済みの画素を流用する。 */
+  void MoveLayer(Layer& layer, Vector2D<int> new_pos);
+  /** @brief 不透明なレイヤーの移動を，back_buffer_ 上の画素の移動と露出部分の再合成で済ませる。
+   *
+   * 上に重なるレイヤーの面積が大きく，流用しても得にならない場合は false を返す。
+   */
+  bool ScrollLayer(Layer& layer, Vector2D<int> new_pos);
+  // Compose の作業領域（描画のたびに確保し直さないよう保持しておく）
+  mutable std::vector<std::pair<const Layer*, Rectangle<int>>> paint_queue_{};
+  mutable std::vector<Rectangle<int>> uncovered_{}, uncovered_next_{};
+
+  std::shared_ptr<Window> cursor_{};
+  Vector2D<int> cursor_pos_{};
+  /** @brief バックバッファの area を画面へコピーし，重なるカーソルを描き直す。 */
+  void CopyToScreen(const Rectangle<int>& area) const;
+
+  bool deferred_{false};
+  /** @brief 遅延描画中に記録した再描画範囲（画面座標） */
+  mutable DamageList pending_{};
+  /** @brief back_buffer_ は最新だが画面へのコピーが済んでいない範囲 */
+  DamageList pending_copy_{};
+  DamageList flushing_{}, flushing_copy_{};
 };
 
 extern LayerManager* layer_manager;
@@ -107,14 +173,12 @@ extern LayerManager* layer_manager;
 class ActiveLayer {
  public:
   ActiveLayer(LayerManager& manager);
-  void SetMouseLayer(unsigned int mouse_layer);
   void Activate(unsigned int layer_id);
   unsigned int GetActive() const { return active_layer_; }
 
  private:
   LayerManager& manager_;
   unsigned int active_layer_{0};
-  unsigned int mouse_layer_{0};
 };
 
 extern ActiveLayer* active_layer;
@@ -16,6 +16,7 @@
 #include "frame_buffer_config.hpp"
 #include "memory_map.hpp"
 #include "graphics.hpp"
+#include "pixel_ops.hpp"
 #include "mouse.hpp"
 #include "font.hpp"
 #include "console.hpp"
@@ -38,6 +39,7 @@
 #include "fat.hpp"
 #include "syscall.hpp"
 #include "uefi.hpp"
+#include "compositor.hpp"
 
 __attribute__((format(printf, 1, 2))) int printk(const char* format, ...) {
   va_list ap;
@@ -186,6 +188,7 @@ extern "C" void KernelMainNewStack(
   MemoryMap memory_map{memory_map_ref};
   uefi_rt = rt;
 
+  InitializePixelOps();
   InitializeGraphics(frame_buffer_config_ref);
   InitializeConsole();
 
@@ -233,17 +236,27 @@ extern "C" void KernelMainNewStack(
     .InitContext(TaskWallclock, 0)
     .Wakeup();
 
+  // 入力処理を担うメインタスク（最高レベル）より下，アプリより上で動かす
+  __asm__("cli");
+  auto& compositor_task = task_manager->NewTask().InitContext(TaskCompositor, 0);
+  task_manager->Wakeup(&compositor_task, Task::kDefaultLevel + 1);
+  __asm__("sti");
+
   char str[128];
+  unsigned long drawn_tick = std::numeric_limits<unsigned long>::max();
 
   while (true) {
     __asm__("cli");
     const auto tick = timer_manager->CurrentTick();
     __asm__("sti");
 
-    sprintf(str, "%010lu", tick);
-    FillRectangle(*main_window->InnerWriter(), {20, 4}, {8 * 10, 16}, {0xc6, 0xc6, 0xc6});
-    WriteString(*main_window->InnerWriter(), {20, 4}, str, {0, 0, 0});
-    layer_manager->Draw(main_window_layer_id);
+    if (tick != drawn_tick) {
+      drawn_tick = tick;
+      sprintf(str, "%010lu", tick);
+      FillRectangle(*main_window->InnerWriter(), {20, 4}, {8 * 10, 16}, {0xc6, 0xc6, 0xc6});
+      WriteString(*main_window->InnerWriter(), {20, 4}, str, {0, 0, 0});
+      layer_manager->Draw(main_window_layer_id);
+    }
 
     __asm__("cli");
     auto msg = main_task.ReceiveMessage();
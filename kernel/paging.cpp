@@ -58,14 +58,29 @@ WithError<PageMapEntry*> SetNewPageMapIfNotPresent(PageMapEntry& entry) {
   return { child_map, MAKE_ERROR(Error::kSuccess) };
 }
 
+/** @brief ページ構造を作りつつ num_4kpages 個のページを割り当てる。
+ *
+ * shared_frame が nullptr なら新しいフレームを割り当てる。
+ * そうでなければ *shared_frame が指す物理フレームから順に割り当て，*shared_frame を進める。
+ */
 WithError<size_t> SetupPageMap(
     PageMapEntry* page_map, int page_map_level, LinearAddress4Level addr,
-    size_t num_4kpages, bool writable) {
+    size_t num_4kpages, bool writable, uintptr_t* shared_frame = nullptr) {
   while (num_4kpages > 0) {
     const auto entry_index = addr.Part(page_map_level);
 
-    auto [ child_map, err ] = SetNewPageMapIfNotPresent(page_map[entry_index]);
-    if (err) {
+    if (page_map_level == 1 && shared_frame) {
+      if (page_map[entry_index].bits.present) {
+        return { num_4kpages, MAKE_ERROR(Error::kAlreadyAllocated) };
+      }
+      page_map[entry_index].data = 0;
+      page_map[entry_index].SetPointer(
+          reinterpret_cast<PageMapEntry*>(*shared_frame));
+      page_map[entry_index].bits.present = 1;
+      page_map[entry_index].bits.shared = 1;
+      *shared_frame += kPageSize4K;
+    } else if (auto [ child_map, err ] =
+                 SetNewPageMapIfNotPresent(page_map[entry_index]); err) {
       return { num_4kpages, err };
     }
     page_map[entry_index].bits.user = 1;
@@ -76,7 +91,8 @@ WithError<size_t> SetupPageMap(
     } else {
       page_map[entry_index].bits.writable = true;
       auto [ num_remain_pages, err ] =
-        SetupPageMap(child_map, page_map_level - 1, addr, num_4kpages, writable);
+        SetupPageMap(page_map[entry_index].Pointer(), page_map_level - 1, addr,
+                     num_4kpages, writable, shared_frame);
       if (err) {
         return { num_4kpages, err };
       }
@@ -110,7 +126,7 @@ Error CleanPageMap(
       }
     }
 
-    if (entry.bits.writable) {
+    if (entry.bits.writable && !entry.bits.shared) {
       const auto entry_addr = reinterpret_cast<uintptr_t>(entry.Pointer());
       const FrameID map_frame{entry_addr / kBytesPerFrame};
       if (auto err = memory_manager->Free(map_frame, 1)) {
@@ -161,6 +177,17 @@ Error SetPageContent(PageMapEntry* table, int part,
   return SetPageContent(table[i].Pointer(), part - 1, addr, content);
 }
 
+PageMapEntry* FindPageEntry(PageMapEntry* page_map, LinearAddress4Level addr) {
+  for (int level = 4; level > 1; --level) {
+    const auto& entry = page_map[addr.Part(level)];
+    if (!entry.bits.present) {
+      return nullptr;
+    }
+    page_map = entry.Pointer();
+  }
+  return &page_map[addr.Part(1)];
+}
+
 Error CopyOnePage(uint64_t causal_addr) {
   auto [ p, err ] = NewPageMap();
   if (err) {
@@ -200,6 +227,46 @@ Error CleanPageMaps(LinearAddress4Level addr) {
   return CleanPageMap(pml4_table, 4, addr);
 }
 
+Error FreePageMaps(LinearAddress4Level addr, size_t num_4kpages) {
+  auto pml4_table = reinterpret_cast<PageMapEntry*>(GetCR3());
+  for (size_t i = 0; i < num_4kpages; ++i) {
+    const LinearAddress4Level page_addr{addr.value + i * kPageSize4K};
+    auto entry = FindPageEntry(pml4_table, page_addr);
+    if (entry == nullptr || !entry->bits.present) {
+      continue;
+    }
+    if (entry->bits.writable && !entry->bits.shared) {
+      const auto entry_addr = reinterpret_cast<uintptr_t>(entry->Pointer());
+      if (auto err = memory_manager->Free(FrameID{entry_addr / kBytesPerFrame}, 1)) {
+        return err;
+      }
+    }
+    entry->data = 0;
+    InvalidateTLB(page_addr.value);
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+Error MapSharedFrames(LinearAddress4Level addr, size_t num_4kpages,
+                      uintptr_t phys_addr) {
+  auto pml4_table = reinterpret_cast<PageMapEntry*>(GetCR3());
+  return SetupPageMap(pml4_table, 4, addr, num_4kpages, true, &phys_addr).error;
+}
+
+Error UnmapSharedFrames(LinearAddress4Level addr, size_t num_4kpages) {
+  auto pml4_table = reinterpret_cast<PageMapEntry*>(GetCR3());
+  for (size_t i = 0; i < num_4kpages; ++i) {
+    const LinearAddress4Level page_addr{addr.value + i * kPageSize4K};
+    auto entry = FindPageEntry(pml4_table, page_addr);
+    if (entry == nullptr || !entry->bits.shared) {
+      return MAKE_ERROR(Error::kNoSuchEntry);
+    }
+    entry->data = 0;
+    InvalidateTLB(page_addr.value);
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
 Error CopyPageMaps(PageMapEntry* dest, PageMapEntry* src, int part, int start) {
   if (part == 1) {
     for (int i = start; i < 512; ++i) {
@@ -74,7 +74,8 @@ union PageMapEntry {
     uint64_t dirty : 1;
     uint64_t huge_page : 1;
     uint64_t global : 1;
-    uint64_t : 3;
+    uint64_t shared : 1; // 他（ウィンドウなど）が所有するフレームを指す
+    uint64_t : 2;
 
     uint64_t addr : 40;
     uint64_t : 12;
@@ -94,5 +95,15 @@ Error FreePageMap(PageMapEntry* table);
 Error SetupPageMaps(LinearAddress4Level addr, size_t num_4kpages,
                     bool writable = true);
 Error CleanPageMaps(LinearAddress4Level addr);
+/** @brief SetupPageMaps で割り当てた addr から num_4kpages 個のページを外し，フレームを解放する。 */
+Error FreePageMaps(LinearAddress4Level addr, size_t num_4kpages);
+/** @brief 物理アドレス phys_addr から連続する num_4kpages 個のフレームを addr に割り当てる。
+ *
+ * 割り当てたページには shared 印を付けるので，CleanPageMaps はフレームを解放しない。
+ */
+Error MapSharedFrames(LinearAddress4Level addr, size_t num_4kpages,
+                      uintptr_t phys_addr);
+/** @brief MapSharedFrames で割り当てたページを外す。フレームは解放しない。 */
+Error UnmapSharedFrames(LinearAddress4Level addr, size_t num_4kpages);
 Error CopyPageMaps(PageMapEntry* dest, PageMapEntry* src, int part, int start);
 Error HandlePageFault(uint64_t error_code, uint64_t causal_addr);
@@ -0,0 +1,248 @@
+#include "pixel_ops.hpp"
+
+#include <cstring>
+#include <cpuid.h>
+#include <emmintrin.h>
+
+namespace {
+  void FillSSE2(uint32_t* dst, uint32_t value, size_t count) {
+    while (count > 0 && (reinterpret_cast<uintptr_t>(dst) & 15)) {
+      *dst++ = value;
+      --count;
+    }
+
+    const __m128i v = _mm_set1_epi32(value);
+    for (; count >= 16; count -= 16, dst += 16) {
+      auto p = reinterpret_cast<__m128i*>(dst);
+      _mm_store_si128(p + 0, v);
+      _mm_store_si128(p + 1, v);
+      _mm_store_si128(p + 2, v);
+      _mm_store_si128(p + 3, v);
+    }
+    for (; count >= 4; count -= 4, dst += 4) {
+      _mm_store_si128(reinterpret_cast<__m128i*>(dst), v);
+    }
+    while (count-- > 0) {
+      *dst++ = value;
+    }
+  }
+
+  void FillERMS(uint32_t* dst, uint32_t value, size_t count) {
+    __asm__ volatile("rep stosl"
+                     : "+D"(dst), "+c"(count) : "a"(value) : "memory");
+  }
+
+  // 64 バイト分を読んでから書くので，dst < src なら重なっていても正しく動く
+  void CopySSE2(void* dst, const void* src, size_t bytes) {
+    auto d = static_cast<uint8_t*>(dst);
+    auto s = static_cast<const uint8_t*>(src);
+    for (; bytes >= 64; bytes -= 64, d += 64, s += 64) {
+      auto sp = reinterpret_cast<const __m128i*>(s);
+      auto dp = reinterpret_cast<__m128i*>(d);
+      const __m128i a = _mm_loadu_si128(sp + 0);
+      const __m128i b = _mm_loadu_si128(sp + 1);
+      const __m128i c = _mm_loadu_si128(sp + 2);
+      const __m128i e = _mm_loadu_si128(sp + 3);
+      _mm_storeu_si128(dp + 0, a);
+      _mm_storeu_si128(dp + 1, b);
+      _mm_storeu_si128(dp + 2, c);
+      _mm_storeu_si128(dp + 3, e);
+    }
+    for (; bytes >= 16; bytes -= 16, d += 16, s += 16) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(d),
+                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(s)));
+    }
+    memmove(d, s, bytes);
+  }
+
+  void CopyERMS(void* dst, const void* src, size_t bytes) {
+    __asm__ volatile("rep movsb"
+                     : "+D"(dst), "+S"(src), "+c"(bytes) : : "memory");
+  }
+
+  // x / 255 を丸めた値。x は 255 * 255 以下
+  inline uint32_t Div255(uint32_t x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+  }
+
+  uint32_t BlendPixel(uint32_t dst, uint32_t src) {
+    const uint32_t a = src >> 24;
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+      const uint32_t s = (src >> shift) & 0xff, d = (dst >> shift) & 0xff;
+      result |= Div255(s * a + d * (255 - a)) << shift;
+    }
+    return result;
+  }
+
+  // 2 画素分（8 個の 16 ビット成分）を合成する
+  inline __m128i Blend2(__m128i d, __m128i s) {
+    const __m128i a = _mm_shufflehi_epi16(
+        _mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    const __m128i inv_a = _mm_xor_si128(a, _mm_set1_epi16(0xff));
+    __m128i x = _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, inv_a));
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+  }
+
+  // マスクの 1 バイトを 8 画素分の 32 ビットマスク（0 か 0xffffffff）に展開する表
+  struct ByteMaskTable {
+    alignas(16) uint32_t masks[256][8];
+
+    constexpr ByteMaskTable() : masks{} {
+      for (int b = 0; b < 256; ++b) {
+        for (int i = 0; i < 8; ++i) {
+          masks[b][i] = (b & (0x80 >> i)) ? 0xffffffffu : 0;
+        }
+      }
+    }
+  };
+  constexpr ByteMaskTable byte_masks;
+
+  void (*fill_impl)(uint32_t*, uint32_t, size_t) = FillSSE2;
+  void (*copy_impl)(void*, const void*, size_t) = CopySSE2;
+}
+
+void FillPixels32(uint32_t* dst, uint32_t value, size_t count) {
+  fill_impl(dst, value, count);
+}
+
+void CopyPixels(void* dst, const void* src, size_t bytes) {
+  copy_impl(dst, src, bytes);
+}
+
+void MovePixels(void* dst, const void* src, size_t bytes) {
+  // 重なる領域の移動は SSE2 で書いても memmove より速くならなかった
+  memmove(dst, src, bytes);
+}
+
+void StreamPixels(void* dst, const void* src, size_t bytes) {
+  auto d = static_cast<uint8_t*>(dst);
+  auto s = static_cast<const uint8_t*>(src);
+  const size_t head = (16 - (reinterpret_cast<uintptr_t>(d) & 15)) & 15;
+  if (bytes < head + 64) {
+    CopySSE2(d, s, bytes);
+    return;
+  }
+  memcpy(d, s, head);
+  d += head;
+  s += head;
+  bytes -= head;
+
+  for (; bytes >= 64; bytes -= 64, d += 64, s += 64) {
+    auto sp = reinterpret_cast<const __m128i*>(s);
+    auto dp = reinterpret_cast<__m128i*>(d);
+    _mm_stream_si128(dp + 0, _mm_loadu_si128(sp + 0));
+    _mm_stream_si128(dp + 1, _mm_loadu_si128(sp + 1));
+    _mm_stream_si128(dp + 2, _mm_loadu_si128(sp + 2));
+    _mm_stream_si128(dp + 3, _mm_loadu_si128(sp + 3));
+  }
+  for (; bytes >= 16; bytes -= 16, d += 16, s += 16) {
+    _mm_stream_si128(reinterpret_cast<__m128i*>(d),
+                     _mm_loadu_si128(reinterpret_cast<const __m128i*>(s)));
+  }
+  memcpy(d, s, bytes);
+}
+
+void StreamFence() {
+  _mm_sfence();
+}
+
+void MaskFillPixels32(uint32_t* dst, const uint8_t* mask, size_t skip,
+                      size_t count, uint32_t value) {
+  mask += skip >> 3;
+  skip &= 7;
+  auto bit_at = [mask](size_t bit) {
+    return mask[bit >> 3] & (0x80u >> (bit & 7));
+  };
+
+  // バイト境界までは 1 画素ずつ
+  size_t i = 0;
+  for (; skip > 0 && skip < 8 && i < count; ++i, ++skip) {
+    if (bit_at(skip)) {
+      dst[i] = value;
+    }
+  }
+  if (skip == 8) {
+    ++mask;
+  }
+
+  const __m128i v = _mm_set1_epi32(value);
+  for (; i + 8 <= count; i += 8, ++mask) {
+    const uint8_t b = *mask;
+    if (b == 0) {
+      continue;
+    }
+    auto p = reinterpret_cast<__m128i*>(dst + i);
+    if (b == 0xff) {
+      _mm_storeu_si128(p + 0, v);
+      _mm_storeu_si128(p + 1, v);
+      continue;
+    }
+    auto m = reinterpret_cast<const __m128i*>(byte_masks.masks[b]);
+    const __m128i m0 = _mm_load_si128(m + 0), m1 = _mm_load_si128(m + 1);
+    _mm_storeu_si128(p + 0, _mm_or_si128(_mm_and_si128(m0, v),
+                                         _mm_andnot_si128(m0, _mm_loadu_si128(p + 0))));
+    _mm_storeu_si128(p + 1, _mm_or_si128(_mm_and_si128(m1, v),
+                                         _mm_andnot_si128(m1, _mm_loadu_si128(p + 1))));
+  }
+  for (size_t bit = 0; i < count; ++i, ++bit) {
+    if (mask[0] & (0x80u >> bit)) {
+      dst[i] = value;
+    }
+  }
+}
+
+void BlendPixels(uint32_t* dst, const uint32_t* src, size_t count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha_mask = _mm_set1_epi32(0xff000000);
+  for (; count >= 4; count -= 4, dst += 4, src += 4) {
+    const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    const int alpha = _mm_movemask_epi8(
+        _mm_cmpeq_epi32(_mm_and_si128(s, alpha_mask), alpha_mask));
+    if (alpha == 0xffff) { // 4 画素とも不透明
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), s);
+      continue;
+    }
+    const int transparent = _mm_movemask_epi8(
+        _mm_cmpeq_epi32(_mm_and_si128(s, alpha_mask), zero));
+    if (transparent == 0xffff) { // 4 画素とも透明
+      continue;
+    }
+
+    auto dp = reinterpret_cast<__m128i*>(dst);
+    const __m128i d = _mm_loadu_si128(dp);
+    const __m128i lo = Blend2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero));
+    const __m128i hi = Blend2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero));
+    _mm_storeu_si128(dp, _mm_packus_epi16(lo, hi));
+  }
+  for (; count > 0; --count, ++dst, ++src) {
+    *dst = BlendPixel(*dst, *src);
+  }
+}
+
+PixelOpsImpl DetectPixelOpsImpl() {
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 9))) {
+    return PixelOpsImpl::kERMS;
+  }
+  return PixelOpsImpl::kSSE2;
+}
+
+void SelectPixelOps(PixelOpsImpl impl) {
+  switch (impl) {
+  case PixelOpsImpl::kSSE2:
+    fill_impl = FillSSE2;
+    copy_impl = CopySSE2;
+    break;
+  case PixelOpsImpl::kERMS:
+    fill_impl = FillERMS;
+    copy_impl = CopyERMS;
+    break;
+  }
+}
+
+void InitializePixelOps() {
+  SelectPixelOps(DetectPixelOpsImpl());
+}
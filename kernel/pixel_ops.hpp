@@ -0,0 +1,47 @@
+/**
+ * @file pixel_ops.hpp
+ *
+ * 画素列の塗りつぶし・コピー・移動を行う行単位の処理を提供する。
+ * どの実装を使うかは InitializePixelOps が CPU の機能を見て選ぶ。
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum class PixelOpsImpl {
+  kSSE2, // SSE2 の 16 バイト単位の読み書き（x86-64 なら必ず使える）
+  kERMS, // rep stosd / rep movsb（Enhanced REP MOVSB/STOSB 対応 CPU 向け）
+};
+
+/** @brief dst から count 画素を value で埋める。 */
+void FillPixels32(uint32_t* dst, uint32_t value, size_t count);
+/** @brief 重ならない領域へ bytes バイトをコピーする。 */
+void CopyPixels(void* dst, const void* src, size_t bytes);
+/** @brief 重なりうる領域へ bytes バイトを移動する。 */
+void MovePixels(void* dst, const void* src, size_t bytes);
+/** @brief キャッシュを経由しない書き込みで bytes バイトをコピーする。
+ *
+ * 書き込み結果を確定させるため，一連のコピーの後に StreamFence を呼ぶこと。
+ */
+void StreamPixels(void* dst, const void* src, size_t bytes);
+void StreamFence();
+/** @brief dst から count 画素のうち，mask のビットが 1 の画素を value にする。
+ *
+ * mask は 1 バイト 8 画素で，最上位ビットが左端の画素。先頭の skip ビットは読み飛ばす。
+ */
+void MaskFillPixels32(uint32_t* dst, const uint8_t* mask, size_t skip,
+                      size_t count, uint32_t value);
+/** @brief src の count 画素を，最上位バイトを不透明度として dst に合成する。
+ *
+ * 不透明度は 0 が透明，255 が不透明。各色成分は src * a + dst * (255 - a) を
+ * 255 で割って丸めた値になる。dst の最上位バイトも同じ式で合成する。
+ */
+void BlendPixels(uint32_t* dst, const uint32_t* src, size_t count);
+
+/** @brief この CPU に最適な実装を返す。 */
+PixelOpsImpl DetectPixelOpsImpl();
+/** @brief FillPixels32 と CopyPixels が使う実装を切り替える。 */
+void SelectPixelOps(PixelOpsImpl impl);
+void InitializePixelOps();
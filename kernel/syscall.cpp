@@ -1,12 +1,15 @@
 #include "syscall.hpp"
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <cerrno>
 #include <cmath>
 #include <cstdio>
 #include <fcntl.h>
+#include <optional>
 #include <cstring>
+#include <vector>
 
 #include "asmfunc.h"
 #include "msr.hpp"
@@ -17,6 +20,9 @@
 #include "timer.hpp"
 #include "keyboard.hpp"
 #include "app_event.hpp"
+#include "syscall_ring.hpp"
+#include "app_graphics.hpp"
+#include "app_io.hpp"
 
 namespace syscall {
   struct Result {
@@ -42,22 +48,122 @@ SYSCALL(LogString) {
   return { len, 0 };
 }
 
-SYSCALL(PutString) {
-  const auto fd = arg1;
-  const char* s = reinterpret_cast<const char*>(arg2);
-  const auto len = arg3;
-  if (len > 1024) {
-    return { 0, E2BIG };
+/** @brief [addr, addr + len) がアプリのアドレス空間（上位半分）に収まるか調べる */
+bool IsUserRange(uint64_t addr, size_t len) {
+  return addr >= 0x8000'0000'0000'0000 && addr + len >= addr;
+}
+
+/** @brief IsUserRange に加え，下位半分にリンクされたアプリ（Linux 互換）の
+ * ELF イメージとヒープ [ImageBegin, DPagingEnd) に収まる範囲も認める */
+bool IsLinuxUserRange(uint64_t addr, size_t len) {
+  if (IsUserRange(addr, len)) {
+    return true;
+  }
+  __asm__("cli");
+  auto& task = task_manager->CurrentTask();
+  __asm__("sti");
+  return addr + len >= addr &&
+    task.ImageBegin() <= addr && addr + len <= task.DPagingEnd();
+}
+
+/** @brief Linux のシステムコールの戻り値の形（失敗なら -errno）に直す */
+Result ToLinuxResult(Result res) {
+  if (res.error) {
+    return { static_cast<uint64_t>(-res.error), res.error };
   }
+  return res;
+}
+
+/** @brief 1 回の FileDescriptor::Write に渡す最大のバイト数 */
+const size_t kWriteChunkBytes = 64 * 1024;
 
+FileDescriptor* GetFileDescriptor(int fd) {
   __asm__("cli");
   auto& task = task_manager->CurrentTask();
   __asm__("sti");
 
-  if (fd < 0 || task.Files().size() <= fd || !task.Files()[fd]) {
+  if (fd < 0 || task.Files().size() <= fd) {
+    return nullptr;
+  }
+  return task.Files()[fd].get();
+}
+
+/** @brief s[0..len) を区切りながら書き込み，書き込めたバイト数を返す */
+size_t WriteChunked(FileDescriptor& fd, const char* s, size_t len) {
+  size_t written = 0;
+  while (written < len) {
+    const size_t n = std::min(len - written, kWriteChunkBytes);
+    const size_t w = fd.Write(&s[written], n);
+    written += w;
+    if (w < n) {
+      break;
+    }
+  }
+  return written;
+}
+
+/** @brief PutString の本体。in_range でバッファがアプリの領域にあるか確かめる */
+Result DoPutString(bool (*in_range)(uint64_t, size_t),
+                   uint64_t arg1, uint64_t arg2, uint64_t arg3) {
+  const int fd = arg1;
+  const char* s = reinterpret_cast<const char*>(arg2);
+  const size_t len = arg3;
+  if (len > 0 && !in_range(arg2, len)) {
+    return { 0, EFAULT };
+  }
+
+  auto file = GetFileDescriptor(fd);
+  if (!file) {
+    return { 0, EBADF };
+  }
+  return { WriteChunked(*file, s, len), 0 };
+}
+
+SYSCALL(PutString) {
+  return DoPutString(IsUserRange, arg1, arg2, arg3);
+}
+
+/** @brief WriteVec の本体。AppIoVec は Linux の struct iovec と同じ配置 */
+Result DoWriteVec(bool (*in_range)(uint64_t, size_t),
+                  uint64_t arg1, uint64_t arg2, uint64_t arg3) {
+  const int fd = arg1;
+  const auto iov = reinterpret_cast<const AppIoVec*>(arg2);
+  const int iovcnt = arg3;
+  if (iovcnt < 0 || iovcnt > APP_IOV_MAX) {
+    return { 0, EINVAL };
+  }
+  if (iovcnt > 0 && !in_range(arg2, sizeof(AppIoVec) * iovcnt)) {
+    return { 0, EFAULT };
+  }
+  // 確かめた後で他のスレッドに書き換えられないよう，区間の一覧は写してから使う
+  const std::vector<AppIoVec> vecs(iov, iov + iovcnt);
+
+  // 途中まで書いてから失敗しないよう，先にすべての区間を確かめる
+  for (const auto& v : vecs) {
+    if (v.len > 0 && !in_range(reinterpret_cast<uint64_t>(v.base), v.len)) {
+      return { 0, EFAULT };
+    }
+  }
+
+  auto file = GetFileDescriptor(fd);
+  if (!file) {
     return { 0, EBADF };
   }
-  return { task.Files()[fd]->Write(s, len), 0 };
+
+  size_t total = 0;
+  for (const auto& v : vecs) {
+    const auto s = reinterpret_cast<const char*>(v.base);
+    const size_t written = WriteChunked(*file, s, v.len);
+    total += written;
+    if (written < v.len) {
+      break;
+    }
+  }
+  return { total, 0 };
+}
+
+SYSCALL(WriteVec) {
+  return DoWriteVec(IsUserRange, arg1, arg2, arg3);
 }
 
 SYSCALL(Exit) {
@@ -67,6 +173,18 @@ SYSCALL(Exit) {
   return { task.OSStackPointer(), static_cast<int>(arg1) };
 }
 
+/** @brief layer_id のウィンドウを task のスレッドグループが開いたか調べる。割り込み禁止で呼ぶ */
+bool OwnsLayer(Task& task, unsigned int layer_id) {
+  const auto it = layer_task_map->find(layer_id);
+  if (it == layer_task_map->end()) {
+    return false;
+  }
+  auto& leader = task.Leader();
+  const auto& threads = leader.Threads();
+  return it->second == task.ID() || it->second == leader.ID() ||
+    std::find(threads.begin(), threads.end(), it->second) != threads.end();
+}
+
 SYSCALL(OpenWindow) {
   const int w = arg1, h = arg2, x = arg3, y = arg4;
   const auto title = reinterpret_cast<const char*>(arg5);
@@ -88,9 +206,13 @@ SYSCALL(OpenWindow) {
   return { layer_id, 0 };
 }
 
+/** @brief SubmitRing が最後にまとめて描く範囲。レイヤー ID ごとに DamageList を持つ */
+using DamageBatch = std::vector<std::pair<unsigned int, DamageList>>;
+
 namespace {
+  /** @brief batch が null でなければ再描画せず，描いた範囲を batch に加える */
   template <class Func, class... Args>
-  Result DoWinFunc(Func f, uint64_t layer_id_flags, Args... args) {
+  Result DoWinFunc(DamageBatch* batch, Func f, uint64_t layer_id_flags, Args... args) {
     const uint32_t layer_flags = layer_id_flags >> 32;
     const unsigned int layer_id = layer_id_flags & 0xffffffff;
 
@@ -101,14 +223,28 @@ namespace {
       return { 0, EBADF };
     }
 
-    const auto res = f(*layer->GetWindow(), args...);
+    // f は描画した範囲を damage に追加する
+    DamageList damage;
+    const auto res = f(*layer->GetWindow(), damage, args...);
     if (res.error) {
       return res;
     }
 
-    if ((layer_flags & 1) == 0) {
+    if ((layer_flags & 1) != 0 || damage.Empty()) {
+      return res;
+    }
+    if (batch) {
+      auto it = std::find_if(batch->begin(), batch->end(),
+                             [layer_id](const auto& e) { return e.first == layer_id; });
+      if (it == batch->end()) {
+        it = batch->insert(batch->end(), {layer_id, DamageList{}});
+      }
+      for (const auto& rect : damage.Rects()) {
+        it->second.Add(rect);
+      }
+    } else {
       __asm__("cli");
-      layer_manager->Draw(layer_id);
+      layer_manager->Draw(layer_id, damage);
       __asm__("sti");
     }
 
@@ -116,39 +252,65 @@ namespace {
   }
 }
 
-SYSCALL(WinWriteString) {
+Result DoWinWriteString(DamageBatch* batch, uint64_t arg1, uint64_t arg2, uint64_t arg3,
+                        uint64_t arg4, uint64_t arg5, uint64_t arg6) {
   return DoWinFunc(
-      [](Window& win,
+      batch,
+      [](Window& win, DamageList& damage,
          int x, int y, uint32_t color, const char* s) {
         WriteString(*win.Writer(), {x, y}, s, ToColor(color));
+        // 1 文字は 1 バイト以上かつ幅 16 ピクセル以下なので，バイト数の 8 倍で覆える
+        damage.Add({{x, y}, {8 * static_cast<int>(strlen(s)), 16}});
         return Result{ 0, 0 };
       }, arg1, arg2, arg3, arg4, reinterpret_cast<const char*>(arg5));
 }
 
-SYSCALL(WinFillRectangle) {
+SYSCALL(WinWriteString) {
+  return DoWinWriteString(nullptr, arg1, arg2, arg3, arg4, arg5, arg6);
+}
+
+Result DoWinFillRectangle(DamageBatch* batch, uint64_t arg1, uint64_t arg2, uint64_t arg3,
+                          uint64_t arg4, uint64_t arg5, uint64_t arg6) {
   return DoWinFunc(
-      [](Window& win,
+      batch,
+      [](Window& win, DamageList& damage,
          int x, int y, int w, int h, uint32_t color) {
         FillRectangle(*win.Writer(), {x, y}, {w, h}, ToColor(color));
+        damage.Add({{x, y}, {w, h}});
         return Result{ 0, 0 };
       }, arg1, arg2, arg3, arg4, arg5, arg6);
 }
 
+SYSCALL(WinFillRectangle) {
+  return DoWinFillRectangle(nullptr, arg1, arg2, arg3, arg4, arg5, arg6);
+}
+
 SYSCALL(GetCurrentTick) {
   return { timer_manager->CurrentTick(), kTimerFreq };
 }
 
-SYSCALL(WinRedraw) {
+Result DoWinRedraw(DamageBatch* batch, uint64_t arg1, uint64_t arg2, uint64_t arg3,
+                   uint64_t arg4, uint64_t arg5, uint64_t arg6) {
   return DoWinFunc(
-      [](Window&) {
+      batch,
+      [](Window& win, DamageList& damage) {
+        damage.Add({{0, 0}, win.Size()});
         return Result{ 0, 0 };
       }, arg1);
 }
 
-SYSCALL(WinDrawLine) {
+SYSCALL(WinRedraw) {
+  return DoWinRedraw(nullptr, arg1, arg2, arg3, arg4, arg5, arg6);
+}
+
+Result DoWinDrawLine(DamageBatch* batch, uint64_t arg1, uint64_t arg2, uint64_t arg3,
+                     uint64_t arg4, uint64_t arg5, uint64_t arg6) {
   return DoWinFunc(
-      [](Window& win,
+      batch,
+      [](Window& win, DamageList& damage,
          int x0, int y0, int x1, int y1, uint32_t color) {
+        damage.Add({{std::min(x0, x1), std::min(y0, y1)},
+                    {abs(x1 - x0) + 1, abs(y1 - y0) + 1}});
         auto sign = [](int x) {
           return (x > 0) ? 1 : (x < 0) ? -1 : 0;
         };
@@ -190,8 +352,33 @@ SYSCALL(WinDrawLine) {
       }, arg1, arg2, arg3, arg4, arg5, arg6);
 }
 
+SYSCALL(WinDrawLine) {
+  return DoWinDrawLine(nullptr, arg1, arg2, arg3, arg4, arg5, arg6);
+}
+
 SYSCALL(CloseWindow) {
   const unsigned int layer_id = arg1 & 0xffffffff;
+
+  __asm__("cli");
+  auto& task = task_manager->CurrentTask();
+  const bool owns = OwnsLayer(task, layer_id);
+  __asm__("sti");
+  // 描画領域を割り当てられるのは開いたアプリだけなので，閉じられるのもそのアプリだけにする
+  if (!owns) {
+    return { EBADF, 0 };
+  }
+  // ウィンドウと共に描画領域が解放されるので，アプリのアドレス空間から外しておく
+  auto& maps = task.SurfaceMaps();
+  auto it = std::find_if(maps.begin(), maps.end(),
+                         [layer_id](const SurfaceMapping& m) {
+                           return m.layer_id == layer_id;
+                         });
+  if (it != maps.end()) {
+    UnmapSharedFrames(LinearAddress4Level{it->vaddr_begin},
+                      (it->vaddr_end - it->vaddr_begin) / 4096);
+    maps.erase(it);
+  }
+
   const auto err = CloseLayer(layer_id);
   if (err.Cause() == Error::kNoSuchEntry) {
     return { EBADF, 0 };
@@ -211,6 +398,13 @@ SYSCALL(ReadEvent) {
   __asm__("sti");
   size_t i = 0;
 
+  // 入力を待つ前に，溜まっている出力を画面に出しておく
+  for (auto& fd : task.Files()) {
+    if (fd) {
+      fd->Flush();
+    }
+  }
+
   while (i < len) {
     __asm__("cli");
     auto msg = task.ReceiveMessage();
@@ -355,6 +549,9 @@ SYSCALL(ReadFile) {
   const int fd = arg1;
   void* buf = reinterpret_cast<void*>(arg2);
   size_t count = arg3;
+  if (count > 0 && !IsUserRange(arg2, count)) {
+    return { 0, EFAULT };
+  }
   __asm__("cli");
   auto& task = task_manager->CurrentTask();
   __asm__("sti");
@@ -389,11 +586,15 @@ SYSCALL(MapFile) {
     return { 0, EBADF };
   }
 
-  *file_size = task.Files()[fd]->Size();
+  const size_t size = task.Files()[fd]->Size();
+  // 同じアドレス空間の他のスレッドと領域が重ならないよう，予約と登録をまとめて行う
+  __asm__("cli");
   const uint64_t vaddr_end = task.FileMapEnd();
-  const uint64_t vaddr_begin = (vaddr_end - *file_size) & 0xffff'ffff'ffff'f000;
+  const uint64_t vaddr_begin = (vaddr_end - size) & 0xffff'ffff'ffff'f000;
   task.SetFileMapEnd(vaddr_begin);
   task.FileMaps().push_back(FileMapping{fd, vaddr_begin, vaddr_end});
+  __asm__("sti");
+  *file_size = size;
   return { vaddr_begin, 0 };
 }
 
@@ -410,6 +611,392 @@ SYSCALL(IsTerminal) {
   return { task.Files()[fd]->IsTerminal(), 0 };
 }
 
+namespace {
+  struct AppThreadInfo {
+    uint64_t entry, arg1, arg2, rsp;
+  };
+
+  void TaskAppThread(uint64_t task_id, int64_t data) {
+    const auto info = reinterpret_cast<AppThreadInfo*>(data);
+    const AppThreadInfo start = *info;
+    delete info;
+
+    __asm__("cli");
+    auto& task = task_manager->CurrentTask();
+    __asm__("sti");
+
+    int ret = CallApp(start.arg1, start.arg2, 3 << 3 | 3, start.entry,
+                      start.rsp, &task.OSStackPointer());
+
+    __asm__("cli");
+    task_manager->Finish(ret);
+  }
+} // namespace
+
+SYSCALL(CreateThread) {
+  const uint64_t entry = arg1;
+  if (entry < 0x8000'0000'0000'0000) {
+    return { 0, EFAULT };
+  }
+  const size_t kMaxStackBytes = 1024 * 1024;
+  if (arg4 > kMaxStackBytes) {
+    return { 0, EINVAL };
+  }
+  const size_t stack_size = arg4 == 0 ? 16 * 4096 : (arg4 + 4095) & ~4095ul;
+
+  __asm__("cli");
+  auto& task = task_manager->CurrentTask();
+  __asm__("sti");
+  auto& leader = task.Leader();
+
+  // スレッドのスタックはメインスレッドのスタックの下（ファイルマップ領域）に確保する。
+  // 他のスレッドの CreateThread や MapFile と重ならないよう，先に範囲を予約してから割り当てる
+  __asm__("cli");
+  const uint64_t stack_end = leader.FileMapEnd();
+  const uint64_t stack_begin = stack_end - stack_size;
+  // デマンドページング領域に食い込む，あるいは上位半分からはみ出すなら確保しない
+  if (stack_begin > stack_end || stack_begin < 0x8000'0000'0000'0000 ||
+      stack_begin < leader.DPagingEnd()) {
+    __asm__("sti");
+    return { 0, ENOMEM };
+  }
+  leader.SetFileMapEnd(stack_begin);
+  __asm__("sti");
+  if (auto err = SetupPageMaps(LinearAddress4Level{stack_begin}, stack_size / 4096)) {
+    FreePageMaps(LinearAddress4Level{stack_begin}, stack_size / 4096);
+    // 後から他の領域が予約されていなければ，予約した範囲を戻す
+    __asm__("cli");
+    if (leader.FileMapEnd() == stack_begin) {
+      leader.SetFileMapEnd(stack_end);
+    }
+    __asm__("sti");
+    return { 0, ENOMEM };
+  }
+
+  auto info = new AppThreadInfo{entry, arg2, arg3, stack_end - 8};
+  __asm__("cli");
+  auto& thread = task_manager->NewTask()
+    .InitContext(TaskAppThread, reinterpret_cast<int64_t>(info))
+    .SetLeader(&leader);
+  leader.Threads().push_back(thread.ID());
+  leader.ThreadStacks().push_back(
+      ThreadStackMapping{thread.ID(), stack_begin, stack_end});
+  thread.Wakeup();
+  __asm__("sti");
+
+  return { thread.ID(), 0 };
+}
+
+SYSCALL(JoinThread) {
+  const uint64_t thread_id = arg1;
+  __asm__("cli");
+  auto& task = task_manager->CurrentTask();
+  __asm__("sti");
+  if (task.ID() == thread_id) {
+    return { 0, EDEADLK };
+  }
+
+  __asm__("cli");
+  auto& threads = task.Threads();
+  auto it = std::find(threads.begin(), threads.end(), thread_id);
+  if (it == threads.end()) {
+    __asm__("sti");
+    return { 0, ESRCH };
+  }
+  threads.erase(it);
+  auto [ exit_code, err ] = task_manager->WaitFinish(thread_id);
+  auto& stacks = task.ThreadStacks();
+  auto stack_it = std::find_if(stacks.begin(), stacks.end(),
+                               [thread_id](const ThreadStackMapping& m) {
+                                 return m.thread_id == thread_id;
+                               });
+  std::optional<ThreadStackMapping> stack;
+  if (stack_it != stacks.end()) {
+    stack = *stack_it;
+    stacks.erase(stack_it);
+  }
+  __asm__("sti");
+
+  // 終了したスレッドのスタックはもう使われないので，ページを外してフレームを返す
+  if (stack) {
+    const size_t num_pages = (stack->vaddr_end - stack->vaddr_begin) / 4096;
+    FreePageMaps(LinearAddress4Level{stack->vaddr_begin}, num_pages);
+  }
+  if (err) {
+    return { 0, ESRCH };
+  }
+  return { static_cast<uint64_t>(exit_code), 0 };
+}
+
+namespace {
+  template <class Conv>
+  void BlitRows(Window& win, Vector2D<int> dst_pos, Vector2D<int> size,
+                const uint8_t* src, size_t stride, int bytes_per_pixel, Conv conv) {
+    std::vector<PixelColor> row(size.x);
+    for (int dy = 0; dy < size.y; ++dy) {
+      const uint8_t* p = src + stride * static_cast<size_t>(dy);
+      for (int dx = 0; dx < size.x; ++dx, p += bytes_per_pixel) {
+        row[dx] = conv(p);
+      }
+      win.WriteSpan(dst_pos + Vector2D<int>{0, dy}, row.data(), size.x);
+    }
+  }
+
+  int AppPixelBytes(AppPixelFormat format) {
+    switch (format) {
+    case kAppPixelXRGB8888: return 4;
+    case kAppPixelRGB888: return 3;
+    case kAppPixelRGBA8888: return 4;
+    case kAppPixelGray8: return 1;
+    case kAppPixelGrayA88: return 2;
+    }
+    return -1;
+  }
+} // namespace
+
+Result DoWinBlit(DamageBatch* batch, uint64_t arg1, uint64_t arg2, uint64_t arg3,
+                 uint64_t arg4, uint64_t arg5, uint64_t arg6) {
+  if (!IsUserRange(arg4, sizeof(AppPixelBuffer))) {
+    return { 0, EFAULT };
+  }
+  // 検査した後で書き換えられないよう，記述子は手元に写してから使う
+  const AppPixelBuffer src = *reinterpret_cast<const AppPixelBuffer*>(arg4);
+  const int bytes_per_pixel = AppPixelBytes(src.format);
+  if (bytes_per_pixel < 0 || src.width < 0 || src.height < 0 || src.stride < 0) {
+    return { 0, EINVAL };
+  }
+  const uint64_t row_bytes = static_cast<uint64_t>(src.width) * bytes_per_pixel;
+  if (static_cast<uint64_t>(src.stride) < row_bytes) {
+    return { 0, EINVAL };
+  }
+  // 最終行の末尾までがアプリの領域に収まることを確かめる
+  const uint64_t pixels = reinterpret_cast<uint64_t>(src.pixels);
+  const uint64_t extent = src.height == 0 ? 0 :
+    static_cast<uint64_t>(src.stride) * (src.height - 1) + row_bytes;
+  if (!IsUserRange(pixels, extent)) {
+    return { 0, EFAULT };
+  }
+
+  return DoWinFunc(
+      batch,
+      [bytes_per_pixel](Window& win, DamageList& damage,
+                        int x, int y, const AppPixelBuffer* src) {
+        const Rectangle<int> src_area{{x, y}, {src->width, src->height}};
+        const auto area = src_area & Rectangle<int>{{0, 0}, win.Size()};
+        if (area.size.x <= 0 || area.size.y <= 0) {
+          return Result{ 0, 0 };
+        }
+
+        damage.Add(area);
+        const auto skip = area.pos - src_area.pos;
+        const auto pixels = reinterpret_cast<const uint8_t*>(src->pixels) +
+          static_cast<size_t>(src->stride) * skip.y +
+          static_cast<size_t>(bytes_per_pixel) * skip.x;
+        auto blit = [&](auto conv) {
+          BlitRows(win, area.pos, area.size, pixels, src->stride,
+                   bytes_per_pixel, conv);
+        };
+
+        switch (src->format) {
+        case kAppPixelXRGB8888:
+          blit([](const uint8_t* p) {
+            return ToColor(*reinterpret_cast<const uint32_t*>(p));
+          });
+          break;
+        case kAppPixelRGB888:
+        case kAppPixelRGBA8888:
+          blit([](const uint8_t* p) { return PixelColor{p[0], p[1], p[2]}; });
+          break;
+        case kAppPixelGray8:
+        case kAppPixelGrayA88:
+          blit([](const uint8_t* p) { return PixelColor{p[0], p[0], p[0]}; });
+          break;
+        }
+        return Result{ static_cast<uint64_t>(area.size.x) * area.size.y, 0 };
+      }, arg1, arg2, arg3, &src);
+}
+
+SYSCALL(WinBlit) {
+  return DoWinBlit(nullptr, arg1, arg2, arg3, arg4, arg5, arg6);
+}
+
+namespace {
+  AppPixelFormat ToAppPixelFormat(PixelFormat format) {
+    return format == kPixelRGBResv8BitPerColor ? kAppPixelRGBA8888
+                                               : kAppPixelXRGB8888;
+  }
+}
+
+SYSCALL(MapWindowSurface) {
+  const unsigned int layer_id = arg1 & 0xffffffff;
+  const auto surface = reinterpret_cast<AppSurface*>(arg2);
+  if (arg2 < 0x8000'0000'0000'0000) {
+    return { 0, EFAULT };
+  }
+
+  __asm__("cli");
+  auto layer = layer_manager->FindLayer(layer_id);
+  auto& task = task_manager->CurrentTask();
+  const bool owns = OwnsLayer(task, layer_id);
+  __asm__("sti");
+  // 他のアプリのウィンドウを割り当てると，閉じられた後も解放済みのフレームが見えてしまう
+  if (layer == nullptr || !owns) {
+    return { 0, EBADF };
+  }
+
+  const auto win = layer->GetWindow();
+  auto [ buf, err ] = win->ShareShadowBuffer();
+  if (err) {
+    return { 0, ENOMEM };
+  }
+  const auto& config = win->ShadowConfig();
+  const int stride = 4 * config.pixels_per_scan_line;
+
+  auto& maps = task.SurfaceMaps();
+  auto it = std::find_if(maps.begin(), maps.end(),
+                         [layer_id](const SurfaceMapping& m) {
+                           return m.layer_id == layer_id;
+                         });
+  uint64_t vaddr_begin;
+  if (it != maps.end()) {
+    vaddr_begin = it->vaddr_begin;
+  } else {
+    const size_t num_pages = (stride * win->Height() + 4095) / 4096;
+    __asm__("cli");
+    const uint64_t vaddr_end = task.FileMapEnd();
+    vaddr_begin = vaddr_end - num_pages * 4096;
+    task.SetFileMapEnd(vaddr_begin);
+    __asm__("sti");
+    if (auto err = MapSharedFrames(LinearAddress4Level{vaddr_begin}, num_pages,
+                                   reinterpret_cast<uintptr_t>(buf))) {
+      return { 0, ENOMEM };
+    }
+    __asm__("cli");
+    maps.push_back(SurfaceMapping{layer_id, vaddr_begin, vaddr_end});
+    __asm__("sti");
+  }
+
+  *surface = AppSurface{
+    reinterpret_cast<void*>(vaddr_begin), win->Width(), win->Height(), stride,
+    ToAppPixelFormat(config.pixel_format)};
+  return { vaddr_begin, 0 };
+}
+
+SYSCALL(WinCommit) {
+  const unsigned int layer_id = arg1 & 0xffffffff;
+  const auto rects = reinterpret_cast<const AppRect*>(arg2);
+  const size_t num_rects = arg3;
+  // DamageList は 16 個を超えるとまとめてしまうので，それ以上細かく渡しても意味がない
+  const size_t kMaxRects = 256;
+  if (num_rects > kMaxRects) {
+    return { 0, EINVAL };
+  }
+  if (num_rects > 0 && !IsUserRange(arg2, sizeof(AppRect) * num_rects)) {
+    return { 0, EFAULT };
+  }
+  const std::vector<AppRect> rect_copy(rects, rects + num_rects);
+
+  DamageList damage;
+  for (const auto& r : rect_copy) {
+    damage.Add({{r.x, r.y}, {r.w, r.h}});
+  }
+
+  __asm__("cli");
+  if (layer_manager->FindLayer(layer_id) == nullptr) {
+    __asm__("sti");
+    return { 0, EBADF };
+  }
+  if (num_rects == 0) {
+    layer_manager->Draw(layer_id);
+  } else {
+    layer_manager->Draw(layer_id, damage);
+  }
+  __asm__("sti");
+  return { damage.Rects().size(), 0 };
+}
+
+SYSCALL(WinSetAlphaBlend) {
+  const bool enable = arg2 != 0;
+  return DoWinFunc(
+      nullptr,
+      [enable](Window& win, DamageList& damage) -> Result {
+        win.SetAlphaBlend(enable);
+        damage.Add({{0, 0}, win.Size()});
+        return { 0, 0 };
+      }, arg1);
+}
+
+SYSCALL(SubmitRing) {
+  if (!IsUserRange(arg1, sizeof(SyscallRing))) {
+    return { 0, EFAULT };
+  }
+  auto ring = reinterpret_cast<SyscallRing*>(arg1);
+
+  // インデックスはアプリも書き換えられるので，手元に写して範囲を確かめてから使う
+  uint32_t sq_head = ring->sq_head, cq_tail = ring->cq_tail;
+  const uint32_t sq_tail = ring->sq_tail, cq_head = ring->cq_head;
+  if (sq_tail - sq_head > SYSCALL_RING_SIZE || cq_tail - cq_head > SYSCALL_RING_SIZE) {
+    return { 0, EINVAL };
+  }
+
+  // 描画系の要求は再描画せずに実行し，描いた範囲だけを最後にレイヤーごとに 1 回描く
+  DamageBatch batch;
+  size_t num_processed = 0;
+  while (sq_head != sq_tail && cq_tail - cq_head < SYSCALL_RING_SIZE) {
+    const SyscallRingEntry sqe = ring->sq[sq_head % SYSCALL_RING_SIZE];
+    const auto a = sqe.args;
+
+    Result res{ 0, 0 };
+    switch (sqe.opcode) {
+    case 0x8000'0001: res = PutString(a[0], a[1], a[2], a[3], a[4], a[5]); break;
+    case 0x8000'0004:
+      res = DoWinWriteString(&batch, a[0], a[1], a[2], a[3], a[4], a[5]);
+      break;
+    case 0x8000'0005:
+      res = DoWinFillRectangle(&batch, a[0], a[1], a[2], a[3], a[4], a[5]);
+      break;
+    case 0x8000'0006: res = GetCurrentTick(a[0], a[1], a[2], a[3], a[4], a[5]); break;
+    case 0x8000'0007:
+      res = DoWinRedraw(&batch, a[0], a[1], a[2], a[3], a[4], a[5]);
+      break;
+    case 0x8000'0008:
+      res = DoWinDrawLine(&batch, a[0], a[1], a[2], a[3], a[4], a[5]);
+      break;
+    case 0x8000'000b: res = CreateTimer(a[0], a[1], a[2], a[3], a[4], a[5]); break;
+    case 0x8000'000d: res = ReadFile(a[0], a[1], a[2], a[3], a[4], a[5]); break;
+    case 0x8000'0014:
+      res = DoWinBlit(&batch, a[0], a[1], a[2], a[3], a[4], a[5]);
+      break;
+    default: res = { 0, ENOSYS };
+    }
+
+    ring->cq[cq_tail % SYSCALL_RING_SIZE] = { sqe.user_data, res.value, res.error };
+    ring->cq_tail = ++cq_tail;
+    ring->sq_head = ++sq_head;
+    ++num_processed;
+  }
+
+  for (const auto& [ layer_id, damage ] : batch) {
+    __asm__("cli");
+    if (layer_manager->FindLayer(layer_id)) {
+      layer_manager->Draw(layer_id, damage);
+    }
+    __asm__("sti");
+  }
+
+  return { num_processed, 0 };
+}
+
+SYSCALL(Splice) {
+  auto src = GetFileDescriptor(arg1);
+  auto dst = GetFileDescriptor(arg2);
+  const size_t len = arg3;
+  if (!src || !dst) {
+    return { 0, EBADF };
+  }
+  return { SpliceFD(*src, *dst, len), 0 };
+}
+
 // Linux System call
 SYSCALL(read) {
   if (arg1 != kError && arg1 != kWarn && arg1 != kInfo && arg1 != kDebug) {
@@ -425,16 +1012,11 @@ SYSCALL(read) {
 }
 
 SYSCALL(write) {
-  if (arg1 != kError && arg1 != kWarn && arg1 != kInfo && arg1 != kDebug) {
-    return { 0, EPERM };
-  }
-  const char* s = reinterpret_cast<const char*>(arg2);
-  const auto len = strlen(s);
-  if (len > 1024) {
-    return { 0, E2BIG };
-  }
-  Log(static_cast<LogLevel>(arg1), "%s", s);
-  return { len, 0 };
+  return ToLinuxResult(DoPutString(IsLinuxUserRange, arg1, arg2, arg3));
+}
+
+SYSCALL(writev) {
+  return ToLinuxResult(DoWriteVec(IsLinuxUserRange, arg1, arg2, arg3));
 }
 
 
@@ -472,8 +1054,10 @@ SYSCALL(dummy) {
   const char *msg1 = "Error: Invalid Syscall Number\n";
   char s[100];
   int length = std::sprintf(s, "There is no Syscall Number: 0x%08X\n", syscallNum);
-  syscall::PutString(1, (uint64_t)msg1, strlen(msg1), 1, 1, 1);
-  syscall::PutString(1, (uint64_t)s, length, 1, 1, 1);
+  if (auto file = GetFileDescriptor(1)) {
+    file->Write(msg1, strlen(msg1));
+    file->Write(s, length);
+  }
   while (true) __asm__("hlt");
   return { 0, 0 };
 }
@@ -489,15 +1073,17 @@ extern "C" syscall::Result invalid_Syscall_num(unsigned int syscallNum){
   // 場所は違うけど、どちらも100byteの配列が作られる
   int length = std::sprintf(s, "There is no Syscall Number: 0x%08X\n", syscallNum);
   // PUtString/Writeは書き込むべきbyte数 -> null文字は含まない
-  syscall::PutString(1, (uint64_t)msg1, strlen(msg1), 1, 1, 1);
-  syscall::PutString(1, (uint64_t)s, length, 1, 1, 1);
+  if (auto file = syscall::GetFileDescriptor(1)) {
+    file->Write(msg1, strlen(msg1));
+    file->Write(s, length);
+  }
   return syscall::Exit(-1, 1, 1, 1, 1, 1);
 }
 
 using SyscallFuncType = syscall::Result (uint64_t, uint64_t, uint64_t,
                                          uint64_t, uint64_t, uint64_t);
 
-extern "C" constexpr unsigned int numSyscall = 0x11;
+extern "C" constexpr unsigned int numSyscall = 0x1a;
 extern "C" std::array<SyscallFuncType*, numSyscall> syscall_table{
   /* 0x00 */ syscall::LogString,
   /* 0x01 */ syscall::PutString,
@@ -516,6 +1102,15 @@ extern "C" std::array<SyscallFuncType*, numSyscall> syscall_table{
   /* 0x0e */ syscall::DemandPages,
   /* 0x0f */ syscall::MapFile,
   /* 0x10 */ syscall::IsTerminal,
+  /* 0x11 */ syscall::CreateThread,
+  /* 0x12 */ syscall::JoinThread,
+  /* 0x13 */ syscall::SubmitRing,
+  /* 0x14 */ syscall::WinBlit,
+  /* 0x15 */ syscall::MapWindowSurface,
+  /* 0x16 */ syscall::WinCommit,
+  /* 0x17 */ syscall::WinSetAlphaBlend,
+  /* 0x18 */ syscall::WriteVec,
+  /* 0x19 */ syscall::Splice,
 };
 
 extern "C" constexpr unsigned int numLinSyscall = 0x9f;
@@ -540,7 +1135,7 @@ extern "C" std::array<SyscallFuncType*, numLinSyscall> syscall_table_lin{
   /* 0x011 */ syscall::dummy,
   /* 0x012 */ syscall::dummy,
   /* 0x013 */ syscall::dummy,
-  /* 0x014 */ syscall::dummy,
+  /* 0x014 */ syscall::writev,
   /* 0x015 */ syscall::dummy,
   /* 0x016 */ syscall::dummy,
   /* 0x017 */ syscall::dummy,
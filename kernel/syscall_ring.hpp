@@ -0,0 +1,37 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* SQ/CQ のエントリ数（2 のべき乗） */
+#define SYSCALL_RING_SIZE 256
+
+/* アプリが積むシステムコール要求。opcode はシステムコール番号（0x80000005 など） */
+struct SyscallRingEntry {
+  uint32_t opcode;
+  uint32_t reserved;
+  uint64_t user_data;
+  uint64_t args[6];
+};
+
+/* カーネルが返す処理結果。user_data は要求の値をそのまま返す */
+struct SyscallRingCompletion {
+  uint64_t user_data;
+  uint64_t value;
+  int error;
+};
+
+/* アプリとカーネルで共有するリング。
+ * sq_tail と cq_head はアプリが，sq_head と cq_tail はカーネルが進める。
+ * 各インデックスは単調増加し，SYSCALL_RING_SIZE で割った余りで配列を参照する。 */
+struct SyscallRing {
+  uint32_t sq_head, sq_tail;
+  uint32_t cq_head, cq_tail;
+  struct SyscallRingEntry sq[SYSCALL_RING_SIZE];
+  struct SyscallRingCompletion cq[SYSCALL_RING_SIZE];
+};
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -79,35 +79,64 @@ std::optional<Message> Task::ReceiveMessage() {
 }
 
 std::vector<std::shared_ptr<::FileDescriptor>>& Task::Files() {
-  return files_;
+  return leader_ ? leader_->files_ : files_;
+}
+
+uint64_t Task::ImageBegin() const {
+  return leader_ ? leader_->image_begin_ : image_begin_;
+}
+
+void Task::SetImageBegin(uint64_t v) {
+  Leader().image_begin_ = v;
 }
 
 uint64_t Task::DPagingBegin() const {
-  return dpaging_begin_;
+  return leader_ ? leader_->dpaging_begin_ : dpaging_begin_;
 }
 
 void Task::SetDPagingBegin(uint64_t v) {
-  dpaging_begin_ = v;
+  Leader().dpaging_begin_ = v;
 }
 
 uint64_t Task::DPagingEnd() const {
-  return dpaging_end_;
+  return leader_ ? leader_->dpaging_end_ : dpaging_end_;
 }
 
 void Task::SetDPagingEnd(uint64_t v) {
-  dpaging_end_ = v;
+  Leader().dpaging_end_ = v;
 }
 
 uint64_t Task::FileMapEnd() const {
-  return file_map_end_;
+  return leader_ ? leader_->file_map_end_ : file_map_end_;
 }
 
 void Task::SetFileMapEnd(uint64_t v) {
-  file_map_end_ = v;
+  Leader().file_map_end_ = v;
 }
 
 std::vector<FileMapping>& Task::FileMaps() {
-  return file_maps_;
+  return leader_ ? leader_->file_maps_ : file_maps_;
+}
+
+std::vector<SurfaceMapping>& Task::SurfaceMaps() {
+  return leader_ ? leader_->surface_maps_ : surface_maps_;
+}
+
+Task& Task::SetLeader(Task* leader) {
+  leader_ = leader;
+  return *this;
+}
+
+Task& Task::Leader() {
+  return leader_ ? *leader_ : *this;
+}
+
+std::vector<uint64_t>& Task::Threads() {
+  return Leader().threads_;
+}
+
+std::vector<ThreadStackMapping>& Task::ThreadStacks() {
+  return Leader().thread_stacks_;
 }
 
 TaskManager::TaskManager() {
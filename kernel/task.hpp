@@ -36,6 +36,16 @@ struct FileMapping {
   uint64_t vaddr_begin, vaddr_end;
 };
 
+struct SurfaceMapping {
+  unsigned int layer_id;
+  uint64_t vaddr_begin, vaddr_end;
+};
+
+struct ThreadStackMapping {
+  uint64_t thread_id;
+  uint64_t vaddr_begin, vaddr_end;
+};
+
 class Task {
  public:
   static const int kDefaultLevel = 1;
@@ -51,6 +61,9 @@ class Task {
   void SendMessage(const Message& msg);
   std::optional<Message> ReceiveMessage();
   std::vector<std::shared_ptr<::FileDescriptor>>& Files();
+  /** @brief アプリの ELF イメージの先頭アドレス。下位半分にリンクされたアプリのバッファ検査に使う。 */
+  uint64_t ImageBegin() const;
+  void SetImageBegin(uint64_t v);
   uint64_t DPagingBegin() const;
   void SetDPagingBegin(uint64_t v);
   uint64_t DPagingEnd() const;
@@ -58,6 +71,17 @@ class Task {
   uint64_t FileMapEnd() const;
   void SetFileMapEnd(uint64_t v);
   std::vector<FileMapping>& FileMaps();
+  /** @brief アプリのアドレス空間に割り当てたウィンドウ描画領域の一覧。 */
+  std::vector<SurfaceMapping>& SurfaceMaps();
+
+  /** @brief このタスクをアプリのスレッドとし，leader とアドレス空間やファイルを共有する。 */
+  Task& SetLeader(Task* leader);
+  /** @brief スレッドならスレッドグループの先頭タスクを，そうでなければ自身を返す。 */
+  Task& Leader();
+  /** @brief 未回収（Join されていない）スレッドの ID 一覧。先頭タスクのみが保持する。 */
+  std::vector<uint64_t>& Threads();
+  /** @brief スレッドごとに確保したスタック領域の一覧。Join 時に解放する。 */
+  std::vector<ThreadStackMapping>& ThreadStacks();
 
   int Level() const { return level_; }
   bool Running() const { return running_; }
@@ -71,9 +95,14 @@ class Task {
   unsigned int level_{kDefaultLevel};
   bool running_{false};
   std::vector<std::shared_ptr<::FileDescriptor>> files_{};
+  uint64_t image_begin_{0};
   uint64_t dpaging_begin_{0}, dpaging_end_{0};
   uint64_t file_map_end_{0};
   std::vector<FileMapping> file_maps_{};
+  std::vector<SurfaceMapping> surface_maps_{};
+  Task* leader_{nullptr};
+  std::vector<uint64_t> threads_{};
+  std::vector<ThreadStackMapping> thread_stacks_{};
 
   Task& SetLevel(int level) { level_ = level; return *this; }
   Task& SetRunning(bool running) { running_ = running; return *this; }
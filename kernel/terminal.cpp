@@ -8,6 +8,7 @@
 
 #include "font.hpp"
 #include "layer.hpp"
+#include "interrupt.hpp"
 #include "pci.hpp"
 #include "asmfunc.h"
 #include "elf.hpp"
@@ -18,12 +19,31 @@
 #include "logger.hpp"
 #include "uefi.hpp"
 #include "tokenizer.hpp"
+#include "compositor.hpp"
+#include "timer.hpp"
 #include "usb/classdriver/cdc.hpp"
 #include "usb/xhci/xhci.hpp"
 
 
 namespace {
 
+// 割り込み禁止の状態で呼ぶ。queue に自身を登録して起こされるまで眠る
+void WaitOn(std::deque<Task*>& queue) {
+  auto& task = task_manager->CurrentTask();
+  if (std::find(queue.begin(), queue.end(), &task) == queue.end()) {
+    queue.push_back(&task);
+  }
+  task.Sleep();
+}
+
+// 割り込み禁止の状態で呼ぶ
+void WakeupAll(std::deque<Task*>& queue) {
+  for (auto task : queue) {
+    task->Wakeup();
+  }
+  queue.clear();
+}
+
 WithError<int> MakeArgVector(std::vector<std::string> args,
     char** argv, int argv_len, char* argbuf, int argbuf_len) {
   int argc = 0;
@@ -217,7 +237,8 @@ WithError<AppLoadInfo> LoadApp(fat::DirectoryEntry& file_entry, Task& task) {
     return { {}, err_load };
   }
 
-  AppLoadInfo app_load{last_addr, elf_header->e_entry, temp_pml4};
+  AppLoadInfo app_load{GetFirstLoadAddress(elf_header), last_addr,
+                       elf_header->e_entry, temp_pml4};
   app_loads->insert(std::make_pair(&file_entry, app_load));
 
   if (auto [ pml4, err ] = SetupPML4(task); err) {
@@ -252,14 +273,28 @@ fat::DirectoryEntry* FindCommand(const char* command,
   return FindCommand(command, apps_entry.first->FirstCluster());
 }
 
+/** @brief 2 つの矩形を囲む矩形を返す。大きさが 0 の矩形は無視する。 */
+Rectangle<int> UnionRect(const Rectangle<int>& a, const Rectangle<int>& b) {
+  if (a.size.x <= 0 || a.size.y <= 0) {
+    return b;
+  } else if (b.size.x <= 0 || b.size.y <= 0) {
+    return a;
+  }
+  const auto pos = ElementMin(a.pos, b.pos);
+  const auto end = ElementMax(a.pos + a.size, b.pos + b.size);
+  return {pos, end - pos};
+}
+
 } // namespace
 
 std::map<fat::DirectoryEntry*, AppLoadInfo>* app_loads;
 
 Terminal::Terminal(Task& task, const TerminalDescriptor* term_desc)
     : task_{task} {
+  int scrollback_lines = kDefaultScrollbackLines;
   if (term_desc) {
     show_window_ = term_desc->show_window;
+    scrollback_lines = term_desc->scrollback_lines;
     for (int i = 0; i < files_.size(); ++i) {
       files_[i] = term_desc->files[i];
     }
@@ -270,6 +305,12 @@ Terminal::Terminal(Task& task, const TerminalDescriptor* term_desc)
     }
   }
 
+  if (!show_window_) {
+    scrollback_lines = 0;
+  }
+  num_lines_ = kRows + std::max(scrollback_lines, 0);
+  cells_.assign(num_lines_ * kColumns, TerminalCell{0, {255, 255, 255}});
+
   if (show_window_) {
     window_ = std::make_shared<ToplevelWindow>(
         kColumns * 8 + 8 + ToplevelWindow::kMarginX,
@@ -288,17 +329,64 @@ Terminal::Terminal(Task& task, const TerminalDescriptor* term_desc)
   cmd_history_.resize(8);
 }
 
+void Terminal::LockGrid() {
+  __asm__("cli");
+  auto& task = task_manager->CurrentTask();
+  while (grid_owner_ != nullptr && grid_owner_ != &task) {
+    WaitOn(grid_waiters_);
+    __asm__("cli");
+  }
+  grid_owner_ = &task;
+  ++grid_lock_depth_;
+  __asm__("sti");
+}
+
+bool Terminal::TryLockGrid() {
+  const bool interrupts_enabled = DisableInterrupts();
+  auto& task = task_manager->CurrentTask();
+  const bool locked = grid_owner_ == nullptr || grid_owner_ == &task;
+  if (locked) {
+    grid_owner_ = &task;
+    ++grid_lock_depth_;
+  }
+  if (interrupts_enabled) {
+    __asm__("sti");
+  }
+  return locked;
+}
+
+void Terminal::UnlockGrid() {
+  const bool interrupts_enabled = DisableInterrupts();
+  if (--grid_lock_depth_ == 0) {
+    grid_owner_ = nullptr;
+    WakeupAll(grid_waiters_);
+  }
+  if (interrupts_enabled) {
+    __asm__("sti");
+  }
+}
+
 Rectangle<int> Terminal::BlinkCursor() {
+  LockGrid();
   cursor_visible_ = !cursor_visible_;
   DrawCursor(cursor_visible_);
 
-  return {CalcCursorPos(), {7, 15}};
+  const auto area = UnionRect(Render(), {CalcCursorPos(), {7, 15}});
+  UnlockGrid();
+  return area;
 }
 
 void Terminal::DrawCursor(bool visible) {
-  if (show_window_) {
-    const auto color = visible ? ToColor(0xffffff) : ToColor(0);
-    FillRectangle(*window_->Writer(), CalcCursorPos(), {7, 15}, color);
+  if (!show_window_) {
+    return;
+  }
+  if (visible && view_offset_ == 0) {
+    FillRectangle(*window_->Writer(), CalcCursorPos(), {7, 15}, {255, 255, 255});
+  } else if (cursor_.x < kColumns) {
+    // カーソルの下のセルは次の Render で描き直す
+    MarkDirty(cursor_.y, cursor_.x, cursor_.x + 1);
+  } else {
+    FillRectangle(*window_->Writer(), CalcCursorPos(), {7, 15}, {0, 0, 0});
   }
 }
 
@@ -309,11 +397,22 @@ Vector2D<int> Terminal::CalcCursorPos() const {
 
 Rectangle<int> Terminal::InputKey(
     uint8_t modifier, uint8_t keycode, char ascii) {
+  LockGrid();
   DrawCursor(false);
 
   Rectangle<int> draw_area{CalcCursorPos(), {8*2, 16}};
 
-  if (ascii == '\n') {
+  if (keycode == 0x4b) { // page up
+    ScrollView(kRows / 2);
+  } else if (keycode == 0x4e) { // page down
+    ScrollView(-kRows / 2);
+  } else if (ascii != 0 || keycode == 0x51 || keycode == 0x52) {
+    ScrollView(-view_offset_); // 入力したら最新の行に戻る
+  }
+
+  if (keycode == 0x4b || keycode == 0x4e) {
+    // 表示位置の変更だけ
+  } else if (ascii == '\n') {
     linebuf_[linebuf_index_] = 0;
     std::vector<std::string> tokens;
     int redir_idx = -1, *p_redir = &redir_idx;
@@ -344,17 +443,17 @@ Rectangle<int> Terminal::InputKey(
       } else {
         Scroll1();
       }
+      // コマンドの実行中は他のタスク（アプリのスレッドなど）もこのターミナルに書く
+      UnlockGrid();
       ExecuteLine(tokens, redir_idx, pipe_idx);
+      FlushOutput();
+      LockGrid();
       Print(">");
     }
-    draw_area.pos = ToplevelWindow::kTopLeftMargin;
-    draw_area.size = window_->InnerSize();
   } else if (ascii == '\b') {
     if (cursor_.x > 1) {
       --cursor_.x;
-      if (show_window_) {
-        FillRectangle(*window_->Writer(), CalcCursorPos(), {8, 16}, {0, 0, 0});
-      }
+      PutCell(cursor_, {0, {255, 255, 255}});
       draw_area.pos = CalcCursorPos();
 
       if (linebuf_index_ > 0) {
@@ -365,9 +464,7 @@ Rectangle<int> Terminal::InputKey(
     if (cursor_.x < kColumns - 1 && linebuf_index_ < kLineMax - 1) {
       linebuf_[linebuf_index_] = ascii;
       ++linebuf_index_;
-      if (show_window_) {
-        WriteAscii(*window_->Writer(), CalcCursorPos(), ascii, {255, 255, 255});
-      }
+      PutCell(cursor_, {static_cast<char32_t>(ascii), {255, 255, 255}});
       ++cursor_.x;
     }
   } else if (keycode == 0x51) { // down arrow
@@ -376,19 +473,164 @@ Rectangle<int> Terminal::InputKey(
     draw_area = HistoryUpDown(1);
   }
 
+  if (!show_window_) {
+    UnlockGrid();
+    return draw_area;
+  }
+  draw_area = UnionRect(draw_area, Render());
   DrawCursor(true);
 
+  draw_area = UnionRect(draw_area, {CalcCursorPos(), {8, 16}});
+  UnlockGrid();
   return draw_area;
 }
 
 void Terminal::Scroll1() {
-  Rectangle<int> move_src{
-    ToplevelWindow::kTopLeftMargin + Vector2D<int>{4, 4 + 16},
-    {8*kColumns, 16*(kRows - 1)}
+  top_line_ = (top_line_ + 1) % num_lines_;
+  num_history_ = std::min(num_history_ + 1, num_lines_ - kRows);
+  ++pending_scroll_;
+
+  // 画素は Render でまとめて動かすので，描き直しの範囲も一緒にずらしておく
+  std::move(dirty_.begin() + 1, dirty_.end(), dirty_.begin());
+  dirty_[kRows - 1] = {0, 0};
+  ClearLine(kRows - 1);
+}
+
+TerminalCell* Terminal::Line(int row) {
+  return &cells_[((top_line_ + row) % num_lines_) * kColumns];
+}
+
+void Terminal::PutCell(Vector2D<int> pos, TerminalCell cell) {
+  Line(pos.y)[pos.x] = cell;
+  MarkDirty(pos.y, pos.x, pos.x + 1);
+}
+
+void Terminal::ClearLine(int row, int begin) {
+  auto line = Line(row);
+  std::fill(line + begin, line + kColumns, TerminalCell{0, {255, 255, 255}});
+  MarkDirty(row, begin, kColumns);
+}
+
+void Terminal::MarkDirty(int row, int begin, int end) {
+  auto& d = dirty_[row];
+  if (d.first >= d.second) {
+    d = {begin, end};
+  } else {
+    d = {std::min(d.first, begin), std::max(d.second, end)};
+  }
+}
+
+void Terminal::ScrollView(int lines) {
+  const int offset = std::clamp(view_offset_ + lines, 0, num_history_);
+  if (offset != view_offset_) {
+    view_offset_ = offset;
+    full_redraw_ = true;
+  }
+}
+
+Rectangle<int> Terminal::Render() {
+  if (!show_window_) {
+    return {{0, 0}, {0, 0}};
+  }
+
+  const auto origin = ToplevelWindow::kTopLeftMargin + Vector2D<int>{4, 4};
+  const bool scrolled = full_redraw_ || pending_scroll_ > 0;
+  if (full_redraw_ || pending_scroll_ >= kRows) {
+    for (auto& d : dirty_) {
+      d = {0, kColumns};
+    }
+  } else if (pending_scroll_ > 0) {
+    // 何行分のスクロールでも画素の移動は 1 回で済ませる
+    Rectangle<int> move_src{
+      origin + Vector2D<int>{0, 16 * pending_scroll_},
+      {8*kColumns, 16*(kRows - pending_scroll_)}
+    };
+    window_->Move(origin, move_src);
+  }
+  full_redraw_ = false;
+  pending_scroll_ = 0;
+
+  int first_row = kRows, last_row = -1;
+  for (int row = 0; row < kRows; ++row) {
+    auto& d = dirty_[row];
+    if (d.first >= d.second) {
+      continue;
+    }
+    RenderLine(row, d.first, d.second);
+    d = {0, 0};
+    first_row = std::min(first_row, row);
+    last_row = row;
+  }
+
+  if (scrolled) {
+    return {origin, {8*kColumns, 16*kRows}};
+  } else if (last_row < 0) {
+    return {{0, 0}, {0, 0}};
+  }
+  return {origin + Vector2D<int>{0, 16 * first_row},
+          {8*kColumns, 16 * (last_row - first_row + 1)}};
+}
+
+void Terminal::RenderLine(int row, int begin, int end) {
+  const int line_index = (top_line_ - view_offset_ + row + num_lines_) % num_lines_;
+  const TerminalCell* line = &cells_[line_index * kColumns];
+
+  // 全角文字の片側だけを描き直さないよう範囲を広げる
+  if (line[begin].c == kWideTail && begin > 0) {
+    --begin;
+  }
+  if (end < kColumns && line[end].c == kWideTail) {
+    ++end;
+  }
+
+  auto& writer = *window_->Writer();
+  const auto origin = ToplevelWindow::kTopLeftMargin + Vector2D<int>{4, 4 + 16 * row};
+  FillRectangle(writer, origin + Vector2D<int>{8 * begin, 0},
+                {8 * (end - begin), 16}, {0, 0, 0});
+
+  // 同じ色の ASCII 文字（空白を含む）が続く間は 1 回の WriteAsciiRun で描く
+  char run[kColumns];
+  int run_begin = begin, run_len = 0;
+  PixelColor run_color{0, 0, 0};
+  auto flush_run = [&]() {
+    if (run_len > 0) {
+      WriteAsciiRun(writer, origin + Vector2D<int>{8 * run_begin, 0},
+                    run, run_len, run_color);
+    }
+    run_len = 0;
   };
-  window_->Move(ToplevelWindow::kTopLeftMargin + Vector2D<int>{4, 4}, move_src);
-  FillRectangle(*window_->InnerWriter(),
-                {4, 4 + 16*cursor_.y}, {8*kColumns, 16}, {0, 0, 0});
+
+  for (int x = begin; x < end; ++x) {
+    const auto& cell = line[x];
+    if (cell.c == kWideTail) {
+      flush_run();
+    } else if (cell.c < 0x80) {
+      const bool blank = cell.c == 0 || cell.c == U' ';
+      if (run_len > 0 && !blank && cell.color != run_color) {
+        flush_run();
+      }
+      if (run_len == 0) {
+        run_begin = x;
+        run_color = cell.color;
+      }
+      run[run_len++] = blank ? ' ' : static_cast<char>(cell.c);
+    } else {
+      flush_run();
+      WriteUnicode(writer, origin + Vector2D<int>{8 * x, 0}, cell.c, cell.color);
+    }
+  }
+  flush_run();
+}
+
+void Terminal::SendDrawArea(const Rectangle<int>& area) {
+  if (area.size.x <= 0 || area.size.y <= 0) {
+    return;
+  }
+  Message msg = MakeLayerMessage(
+      task_.ID(), LayerID(), LayerOperation::DrawArea, area);
+  __asm__("cli");
+  task_manager->SendMessage(1, msg);
+  __asm__("sti");
 }
 
 void Terminal::ExecuteLine(std::vector<std::string>& args, int redir_idx, int pipe_idx) {
@@ -433,11 +675,12 @@ void Terminal::ExecuteLine(std::vector<std::string>& args, int redir_idx, int pi
     char* subcommand = &pipe_char[1];
 
     auto& subtask = task_manager->NewTask();
-    pipe_fd = std::make_shared<PipeDescriptor>(subtask);
+    pipe_fd = std::make_shared<PipeDescriptor>();
     auto term_desc = new TerminalDescriptor{
       subcommand, true, false,
       { pipe_fd, files_[1], files_[2] }
     };
+    term_desc->input_pipe = pipe_fd;
     files_[1] = pipe_fd;
 
     subtask_id = subtask
@@ -465,11 +708,12 @@ void Terminal::ExecuteLine(std::vector<std::string>& args, int redir_idx, int pi
     }
     PrintToFD(*files_[1], "\n");
   } else if (strcmp(command, "clear") == 0) {
-    if (show_window_) {
-      FillRectangle(*window_->InnerWriter(),
-                    {4, 4}, {8*kColumns, 16*kRows}, {0, 0, 0});
+    LockGrid();
+    for (int row = 0; row < kRows; ++row) {
+      ClearLine(row);
     }
     cursor_.y = 0;
+    UnlockGrid();
   } else if (strcmp(command, "lspci") == 0) {
     for (int i = 0; i < pci::num_device; ++i) {
       const auto& dev = pci::devices[i];
@@ -540,16 +784,13 @@ void Terminal::ExecuteLine(std::vector<std::string>& args, int redir_idx, int pi
     for (int i = 0; i < fd_vec.size(); i++) {
       auto fd = fd_vec[i];
       if (fd) {
-        char u8buf[1024];
+        LockGrid();
         DrawCursor(false);
-        while (true) {
-          size_t read_size = ReadDelim(*fd, '\n', u8buf, sizeof(u8buf));
-          if (read_size == 0) {
-            break;
-          }
-          files_[1]->Write(u8buf, read_size);
-        }
+        UnlockGrid();
+        SpliceFD(*fd, *files_[1], std::numeric_limits<size_t>::max());
+        LockGrid();
         DrawCursor(true);
+        UnlockGrid();
       }
     }
   } else if (strcmp(command, "noterm") == 0) {
@@ -568,6 +809,25 @@ void Terminal::ExecuteLine(std::vector<std::string>& args, int redir_idx, int pi
     PrintToFD(*files_[1], "Phys total: %lu frames (%llu MiB)\n",
         p_stat.total_frames,
         p_stat.total_frames * kBytesPerFrame / 1024 / 1024);
+  } else if (strcmp(command, "fontstat") == 0) {
+    const auto g_stat = GetGlyphCacheStat();
+    PrintToFD(*files_[1], "Glyphs: %lu / %lu cached\n",
+        g_stat.entries, g_stat.capacity);
+    PrintToFD(*files_[1], "Hits: %lu, misses: %lu, evictions: %lu\n",
+        g_stat.hits, g_stat.misses, g_stat.evictions);
+  } else if (strcmp(command, "compstat") == 0) {
+    const auto c_stat = GetCompositorStat();
+    PrintToFD(*files_[1], "Frames: %lu (idle %lu), every %d ms, worst %lu us\n",
+        c_stat.frames, c_stat.idle_frames,
+        kCompositorFrameTicks * 1000 / kTimerFreq, c_stat.max_us);
+    for (int i = 0; i < CompositorStat::kNumBuckets; ++i) {
+      const int lower = i == 0 ? 0 : 1 << (i - 1);
+      if (i == CompositorStat::kNumBuckets - 1) {
+        PrintToFD(*files_[1], "  >= %2d ms: %lu\n", lower, c_stat.histogram[i]);
+      } else {
+        PrintToFD(*files_[1], "  < %3d ms: %lu\n", 1 << i, c_stat.histogram[i]);
+      }
+    }
   } else if (strcmp(command, "date") == 0) {
     EFI_TIME t;
     uefi_rt->GetTime(&t, nullptr);
@@ -776,17 +1036,34 @@ WithError<int> Terminal::ExecuteFile(fat::DirectoryEntry& file_entry,
 
   const uint64_t elf_next_page =
     (app_load.vaddr_end + 4095) & 0xffff'ffff'ffff'f000;
+  task.SetImageBegin(app_load.vaddr_begin & 0xffff'ffff'ffff'f000);
   task.SetDPagingBegin(elf_next_page);
   task.SetDPagingEnd(elf_next_page);
 
   task.SetFileMapEnd(stack_frame_addr.value);
 
-  int ret = CallApp(argc.value, argv, 3 << 3 | 3, app_load.entry,
+  int ret = CallApp(argc.value, reinterpret_cast<uint64_t>(argv),
+                    3 << 3 | 3, app_load.entry,
                     stack_frame_addr.value + stack_size - 8,
                     &task.OSStackPointer());
 
+  // Join されずに残っているスレッドが全て終了するまでアドレス空間を破棄しない
+  while (true) {
+    __asm__("cli");
+    if (task.Threads().empty()) {
+      __asm__("sti");
+      break;
+    }
+    const auto thread_id = task.Threads().back();
+    task.Threads().pop_back();
+    task_manager->WaitFinish(thread_id);
+    __asm__("sti");
+  }
+
   task.Files().clear();
   task.FileMaps().clear();
+  task.SurfaceMaps().clear();
+  task.ThreadStacks().clear();
 
   if (auto err = CleanPageMaps(LinearAddress4Level{0xffff'8000'0000'0000})) {
     return { ret, err };
@@ -859,6 +1136,7 @@ void Terminal::Print(char32_t c) {
   if (!show_window_) {
     return;
   }
+  const TerminalCell cell{c, text_color_};
 
   auto newline = [this]() {
     cursor_.x = 0;
@@ -875,25 +1153,28 @@ void Terminal::Print(char32_t c) {
     if (cursor_.x == kColumns) {
       newline();
     }
-    WriteUnicode(*window_->Writer(), CalcCursorPos(), c, text_color_);
+    PutCell(cursor_, cell);
     ++cursor_.x;
   } else {
     if (cursor_.x >= kColumns - 1) {
       newline();
     }
-    WriteUnicode(*window_->Writer(), CalcCursorPos(), c, text_color_);
+    PutCell(cursor_, cell);
+    PutCell(cursor_ + Vector2D<int>{1, 0}, {kWideTail, text_color_});
     cursor_.x += 2;
   }
 }
 
 void Terminal::Print(const char* s, std::optional<size_t> len) {
-  const auto cursor_before = CalcCursorPos();
+  LockGrid();
+  const Rectangle<int> cursor_before{CalcCursorPos(), {8, 16}};
   DrawCursor(false);
+  ScrollView(-view_offset_);
 
   size_t i = 0;
   const size_t len_ = len ? *len : std::numeric_limits<size_t>::max();
 
-  while (s[i] && i < len_) {
+  while (i < len_ && s[i]) {
     const auto [ u32, bytes ] = ConvertUTF8To32(&s[i]);
     if (bytes > 0) {
       Print(u32);
@@ -904,31 +1185,124 @@ void Terminal::Print(const char* s, std::optional<size_t> len) {
     }
   }
 
+  if (!show_window_) {
+    UnlockGrid();
+    return;
+  }
+
+  // 文字はセルに書いただけなので，ここで変更のあった部分をまとめて描く
+  auto draw_area = UnionRect(cursor_before, Render());
   DrawCursor(true);
-  const auto cursor_after = CalcCursorPos();
+  SendDrawArea(UnionRect(draw_area, {CalcCursorPos(), {8, 16}}));
+  UnlockGrid();
+}
 
-  Vector2D<int> draw_pos{ToplevelWindow::kTopLeftMargin.x, cursor_before.y};
-  Vector2D<int> draw_size{window_->InnerSize().x,
-                          cursor_after.y - cursor_before.y + 16};
+void Terminal::Write(const char* s, size_t len) {
+  // 同じターミナルに複数のスレッドが書くことがあるので，溜めた出力は割り込み禁止中に触る
+  while (len > 0) {
+    const bool interrupts_enabled = DisableInterrupts();
+    const size_t n = std::min(len, kOutputBufferSize - out_len_);
+    memcpy(&out_buf_[out_len_], s, n);
+    out_len_ += n;
+    const bool full = out_len_ == kOutputBufferSize;
+    if (interrupts_enabled) {
+      __asm__("sti");
+    }
+    s += n;
+    len -= n;
+    if (full) {
+      FlushOutput(true);
+    }
+  }
 
-  Rectangle<int> draw_area{draw_pos, draw_size};
+  const bool interrupts_enabled = DisableInterrupts();
+  const auto now = timer_manager->CurrentTick();
+  const bool flush = now - last_flush_tick_ >= kCompositorFrameTicks;
+  if (interrupts_enabled) {
+    __asm__("sti");
+  }
+  if (flush) {
+    FlushOutput();
+  } else {
+    // 書き込みが途絶えても残りが次のフレームで描かれるようにしておく
+    QueueFlush();
+  }
+}
 
-  Message msg = MakeLayerMessage(
-      task_.ID(), LayerID(), LayerOperation::DrawArea, draw_area);
-  __asm__("cli");
-  task_manager->SendMessage(1, msg);
-  __asm__("sti");
+namespace {
+  // 次のフレームで描く出力を持つターミナルの片方向リスト
+  Terminal* pending_flush_head = nullptr;
 }
 
-void Terminal::Redraw() {
-  Rectangle<int> draw_area{ToplevelWindow::kTopLeftMargin,
-                           window_->InnerSize()};
+void Terminal::QueueFlush() {
+  const bool interrupts_enabled = DisableInterrupts();
+  if (!flush_queued_) {
+    flush_queued_ = true;
+    next_pending_flush_ = pending_flush_head;
+    pending_flush_head = this;
+  }
+  if (interrupts_enabled) {
+    __asm__("sti");
+  }
+}
 
-  Message msg = MakeLayerMessage(
-      task_.ID(), LayerID(), LayerOperation::DrawArea, draw_area);
+void Terminal::FlushPendingOutputs() {
   __asm__("cli");
-  task_manager->SendMessage(1, msg);
+  Terminal* term = pending_flush_head;
+  pending_flush_head = nullptr;
   __asm__("sti");
+
+  while (term) {
+    __asm__("cli");
+    Terminal* next = term->next_pending_flush_;
+    term->flush_queued_ = false;
+    __asm__("sti");
+
+    // 他のタスクが描いている最中なら待たずに次のフレームへ回す
+    if (term->TryLockGrid()) {
+      term->FlushOutput();
+      term->UnlockGrid();
+    } else {
+      term->QueueFlush();
+    }
+    term = next;
+  }
+}
+
+void Terminal::FlushOutput(bool keep_partial) {
+  // 取り出してから描くまでに他のタスクの出力が先に描かれないよう，格子を確保しておく
+  LockGrid();
+  const bool interrupts_enabled = DisableInterrupts();
+  last_flush_tick_ = timer_manager->CurrentTick();
+  if (out_len_ == 0) {
+    if (interrupts_enabled) {
+      __asm__("sti");
+    }
+    UnlockGrid();
+    return;
+  }
+
+  // 途中で切れた UTF-8 文字は後続のバイトが届くまで残しておく
+  size_t keep = 0;
+  for (size_t back = 1; keep_partial && back <= 3 && back <= out_len_; ++back) {
+    const uint8_t c = out_buf_[out_len_ - back];
+    if ((c & 0xc0) != 0x80) {
+      if (CountUTF8Size(c) > back) {
+        keep = back;
+      }
+      break;
+    }
+  }
+
+  // 描画には時間がかかるので，取り出してから割り込みを許可して描く
+  const std::string chunk(&out_buf_[0], out_len_ - keep);
+  memmove(&out_buf_[0], &out_buf_[out_len_ - keep], keep);
+  out_len_ = keep;
+  if (interrupts_enabled) {
+    __asm__("sti");
+  }
+  Print(chunk.data(), chunk.size());
+  UnlockGrid();
 }
 
 Rectangle<int> Terminal::HistoryUpDown(int direction) {
@@ -939,10 +1313,8 @@ Rectangle<int> Terminal::HistoryUpDown(int direction) {
   }
 
   cursor_.x = 1;
-  const auto first_pos = CalcCursorPos();
-
-  Rectangle<int> draw_area{first_pos, {8*(kColumns - 1), 16}};
-  FillRectangle(*window_->Writer(), draw_area.pos, draw_area.size, {0, 0, 0});
+  Rectangle<int> draw_area{CalcCursorPos(), {8*(kColumns - 1), 16}};
+  ClearLine(cursor_.y, 1);
 
   const char* history = "";
   if (cmd_history_index_ >= 0) {
@@ -952,7 +1324,10 @@ Rectangle<int> Terminal::HistoryUpDown(int direction) {
   strcpy(&linebuf_[0], history);
   linebuf_index_ = strlen(history);
 
-  WriteString(*window_->Writer(), first_pos, history, {255, 255, 255});
+  auto line = Line(cursor_.y);
+  for (int i = 0; i < linebuf_index_ && i + 1 < kColumns; ++i) {
+    line[i + 1] = {static_cast<char32_t>(history[i]), {255, 255, 255}};
+  }
   cursor_.x = linebuf_index_ + 1;
   return draw_area;
 }
@@ -982,6 +1357,10 @@ void TaskTerminal(uint64_t task_id, int64_t data) {
   }
 
   if (term_desc && term_desc->exit_after_command) {
+    if (term_desc->input_pipe) {
+      // 書き込み側が読まれないデータを待ち続けないようにする
+      term_desc->input_pipe->FinishRead();
+    }
     delete term_desc;
     __asm__("cli");
     task_manager->Finish(terminal->LastExitCode());
@@ -1051,6 +1430,7 @@ TerminalFileDescriptor::TerminalFileDescriptor(Terminal& term)
 
 size_t TerminalFileDescriptor::Read(void* buf, size_t len) {
   char* bufc = reinterpret_cast<char*>(buf);
+  term_.FlushOutput();
 
   while (true) {
     __asm__("cli");
@@ -1076,82 +1456,87 @@ size_t TerminalFileDescriptor::Read(void* buf, size_t len) {
 
     bufc[0] = msg->arg.keyboard.ascii;
     term_.Print(bufc, 1);
-    term_.Redraw();
     return 1;
   }
 }
 
 size_t TerminalFileDescriptor::Write(const void* buf, size_t len) {
-  term_.Print(reinterpret_cast<const char*>(buf), len);
-  term_.Redraw();
+  term_.Write(reinterpret_cast<const char*>(buf), len);
   return len;
 }
 
+void TerminalFileDescriptor::Flush() {
+  term_.FlushOutput();
+}
+
 size_t TerminalFileDescriptor::Load(void* buf, size_t len, size_t offset) {
   return 0;
 }
 
-PipeDescriptor::PipeDescriptor(Task& task) : task_{task} {
+PipeDescriptor::PipeDescriptor() : buf_{new char[kBufferSize]} {
 }
 
 size_t PipeDescriptor::Read(void* buf, size_t len) {
-  if (len_ > 0) {
-    const size_t copy_bytes = std::min(len_, len);
-    memcpy(buf, data_, copy_bytes);
-    len_ -= copy_bytes;
-    memmove(data_, &data_[copy_bytes], len_);
-    return copy_bytes;
-  }
-
-  if (closed_) {
+  if (len == 0) {
     return 0;
   }
 
-  while (true) {
+  __asm__("cli");
+  while (read_pos_ == write_pos_ && !write_closed_) {
+    WaitOn(readers_);
     __asm__("cli");
-    auto msg = task_.ReceiveMessage();
-    if (!msg) {
-      task_.Sleep();
-      continue;
-    }
-    __asm__("sti");
-
-    if (msg->type != Message::kPipe) {
-      continue;
-    }
+  }
 
-    if (msg->arg.pipe.len == 0) {
-      closed_ = true;
-      return 0;
-    }
+  const size_t n = std::min(len, write_pos_ - read_pos_);
+  const size_t offset = read_pos_ % kBufferSize;
+  const size_t first = std::min(n, kBufferSize - offset);
+  auto bufc = reinterpret_cast<char*>(buf);
+  memcpy(bufc, &buf_[offset], first);
+  memcpy(&bufc[first], &buf_[0], n - first);
+  read_pos_ += n;
 
-    const size_t copy_bytes = std::min<size_t>(msg->arg.pipe.len, len);
-    memcpy(buf, msg->arg.pipe.data, copy_bytes);
-    len_ = msg->arg.pipe.len - copy_bytes;
-    memcpy(data_, &msg->arg.pipe.data[copy_bytes], len_);
-    return copy_bytes;
-  }
+  WakeupAll(writers_);
+  __asm__("sti");
+  return n;
 }
 
 size_t PipeDescriptor::Write(const void* buf, size_t len) {
   auto bufc = reinterpret_cast<const char*>(buf);
-  Message msg{Message::kPipe};
-  size_t sent_bytes = 0;
-  while (sent_bytes < len) {
-    msg.arg.pipe.len = std::min(len - sent_bytes, sizeof(msg.arg.pipe.data));
-    memcpy(msg.arg.pipe.data, &bufc[sent_bytes], msg.arg.pipe.len);
-    sent_bytes += msg.arg.pipe.len;
-    __asm__("cli");
-    task_.SendMessage(msg);
-    __asm__("sti");
+  size_t written = 0;
+
+  __asm__("cli");
+  while (written < len && !read_closed_) {
+    const size_t space = kBufferSize - (write_pos_ - read_pos_);
+    if (space == 0) {
+      WaitOn(writers_);
+      __asm__("cli");
+      continue;
+    }
+
+    const size_t n = std::min(space, len - written);
+    const size_t offset = write_pos_ % kBufferSize;
+    const size_t first = std::min(n, kBufferSize - offset);
+    memcpy(&buf_[offset], &bufc[written], first);
+    memcpy(&buf_[0], &bufc[written + first], n - first);
+    write_pos_ += n;
+    written += n;
+
+    WakeupAll(readers_);
   }
-  return len;
+  __asm__("sti");
+  return written;
 }
 
 void PipeDescriptor::FinishWrite() {
-  Message msg{Message::kPipe};
-  msg.arg.pipe.len = 0;
   __asm__("cli");
-  task_.SendMessage(msg);
+  write_closed_ = true;
+  WakeupAll(readers_);
+  __asm__("sti");
+}
+
+void PipeDescriptor::FinishRead() {
+  __asm__("cli");
+  read_closed_ = true;
+  WakeupAll(writers_);
   __asm__("sti");
 }
@@ -11,6 +11,8 @@
 #include <map>
 #include <memory>
 #include <optional>
+#include <utility>
+#include <vector>
 #include "window.hpp"
 #include "task.hpp"
 #include "layer.hpp"
@@ -18,17 +20,31 @@
 #include "graphics.hpp"
 
 struct AppLoadInfo {
-  uint64_t vaddr_end, entry;
+  uint64_t vaddr_begin, vaddr_end, entry;
   PageMapEntry* pml4;
 };
 
 extern std::map<fat::DirectoryEntry*, AppLoadInfo>* app_loads;
 
+class PipeDescriptor;
+
+/** @brief 画面外に遡って見られる行数の既定値 */
+const int kDefaultScrollbackLines = 256;
+
 struct TerminalDescriptor {
   std::string command_line;
   bool exit_after_command;
   bool show_window;
   std::array<std::shared_ptr<FileDescriptor>, 3> files;
+  int scrollback_lines{kDefaultScrollbackLines};
+  // パイプの読み出し側として動くなら，終了時に閉じるパイプ
+  std::shared_ptr<PipeDescriptor> input_pipe{};
+};
+
+/** @brief ターミナルの 1 文字分のセル */
+struct TerminalCell {
+  char32_t c; // 0 なら空白。全角文字の右半分は Terminal::kWideTail
+  PixelColor color;
 };
 
 enum class EscSeqState {
@@ -42,6 +58,8 @@ class Terminal {
  public:
   static const int kRows = 15, kColumns = 60;
   static const int kLineMax = 128;
+  static const char32_t kWideTail = 0xffffffff;
+  static const size_t kOutputBufferSize = 4096;
 
   Terminal(Task& task, const TerminalDescriptor* term_desc);
   unsigned int LayerID() const { return layer_id_; }
@@ -49,10 +67,19 @@ class Terminal {
   Rectangle<int> InputKey(uint8_t modifier, uint8_t keycode, char ascii);
 
   void Print(const char* s, std::optional<size_t> len = std::nullopt);
+  /** @brief 出力を溜めておき，描画は 1 フレームに 1 回程度にまとめる */
+  void Write(const char* s, size_t len);
+  /** @brief 溜めてある出力をすべて描く */
+  void FlushOutput(bool keep_partial = false);
+  /** @brief 出力を溜めたまま書き込みが途絶えたターミナルを描く。
+   *
+   * ターミナルのタスクはアプリの実行中にメッセージを処理しないので，
+   * 常に動いている合成タスクが毎フレーム呼ぶ。
+   */
+  static void FlushPendingOutputs();
 
   Task& UnderlyingTask() const { return task_; }
   int LastExitCode() const { return last_exit_code_; }
-  void Redraw();
 
  private:
   std::shared_ptr<ToplevelWindow> window_;
@@ -68,6 +95,45 @@ class Terminal {
   std::array<char, kLineMax> linebuf_{};
   void Scroll1();
 
+  // 文字セルの格子。可視行とスクロールバックを 1 本のリングバッファに持ち，
+  // スクロールは先頭行の位置をずらすだけで行う。
+  std::vector<TerminalCell> cells_{};
+  int num_lines_{0};      // リングの行数（kRows + スクロールバック行数）
+  int top_line_{0};       // 可視行 0 行目のリング上の位置
+  int num_history_{0};    // top_line_ より前にある有効な行数
+  int view_offset_{0};    // スクロールバックを遡って表示している行数
+  int pending_scroll_{0}; // まだ画素に反映していないスクロール行数
+  bool full_redraw_{false};
+  // 可視行ごとに再描画が必要な列の範囲 [first, second)
+  std::array<std::pair<int, int>, kRows> dirty_{};
+
+  TerminalCell* Line(int row);
+  void PutCell(Vector2D<int> pos, TerminalCell cell);
+  void ClearLine(int row, int begin = 0);
+  void MarkDirty(int row, int begin, int end);
+  void ScrollView(int lines);
+  /** @brief 変更のあったセルだけを描き，描き直した範囲を返す */
+  Rectangle<int> Render();
+  void RenderLine(int row, int begin, int end);
+  void SendDrawArea(const Rectangle<int>& area);
+
+  // セルの格子（cells_, cursor_, dirty_ など）を触れるのは 1 タスクずつ。
+  // 同じタスクは入れ子に確保できる。割り込み許可中に呼ぶ
+  Task* grid_owner_{nullptr};
+  int grid_lock_depth_{0};
+  std::deque<Task*> grid_waiters_{};
+  void LockGrid();
+  /** @brief 他のタスクが確保していれば待たずに false を返す */
+  bool TryLockGrid();
+  void UnlockGrid();
+
+  std::array<char, kOutputBufferSize> out_buf_{};
+  size_t out_len_{0};
+  unsigned long last_flush_tick_{0};
+  bool flush_queued_{false};          // FlushPendingOutputs の待ち行列に入っているか
+  Terminal* next_pending_flush_{nullptr};
+  void QueueFlush();
+
   void ExecuteLine(std::vector<std::string>& tokens, int redir, int pipes);
   WithError<int> ExecuteFile(fat::DirectoryEntry& file_entry,
                              const char* command, std::vector<std::string>& args);
@@ -95,25 +161,36 @@ class TerminalFileDescriptor : public FileDescriptor {
   size_t Write(const void* buf, size_t len) override;
   size_t Size() const override { return 0; }
   bool IsTerminal() const override { return true; }
+  void Flush() override;
   size_t Load(void* buf, size_t len, size_t offset) override;
 
  private:
   Terminal& term_;
 };
 
+/** @brief タスク間でデータを受け渡すリングバッファ
+ *
+ * バッファが空なら読み出し側が，満杯なら書き込み側が眠って待つ。
+ */
 class PipeDescriptor : public FileDescriptor {
  public:
-  explicit PipeDescriptor(Task& task);
+  static const size_t kBufferSize = 64 * 1024;
+
+  PipeDescriptor();
   size_t Read(void* buf, size_t len) override;
   size_t Write(const void* buf, size_t len) override;
   size_t Size() const override { return 0; }
   size_t Load(void* buf, size_t len, size_t offset) override { return 0; }
 
+  /** @brief 書き込み側を閉じる。読み出し側は残りを読み終えると EOF（0）を得る。 */
   void FinishWrite();
+  /** @brief 読み出し側を閉じる。以降の書き込みは捨てられる。 */
+  void FinishRead();
 
  private:
-  Task& task_;
-  char data_[16];
-  size_t len_{0};
-  bool closed_{false};
+  std::unique_ptr<char[]> buf_;
+  // 読み書きした累計バイト数。kBufferSize で割った余りがバッファ上の位置
+  size_t read_pos_{0}, write_pos_{0};
+  bool write_closed_{false}, read_closed_{false};
+  std::deque<Task*> readers_{}, writers_{}; // 空き・データを待って眠っているタスク
 };
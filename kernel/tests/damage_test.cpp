@@ -0,0 +1,107 @@
+#include "damage_test.hpp"
+
+#include <cstdio>
+
+#include "../damage.hpp"
+
+namespace {
+  bool RectEqual(const Rectangle<int>& a, const Rectangle<int>& b) {
+    return a.pos.x == b.pos.x && a.pos.y == b.pos.y &&
+           a.size.x == b.size.x && a.size.y == b.size.y;
+  }
+
+  void PrintRect(const Rectangle<int>& r) {
+    printf("{%d,%d %dx%d}", r.pos.x, r.pos.y, r.size.x, r.size.y);
+  }
+}
+
+int test_damage() {
+  int ret = 0;
+  struct {
+    const char* name;
+    std::vector<Rectangle<int>> input;
+    std::vector<Rectangle<int>> expected;
+  } tbl[] = {
+    /* 00 */ {"empty rect is ignored", {{{0, 0}, {0, 10}}, {{5, 5}, {10, -1}}}, {}},
+    /* 01 */ {"overlapping rects merge",
+              {{{0, 0}, {10, 10}}, {{5, 5}, {10, 10}}}, {{{0, 0}, {15, 15}}}},
+    /* 02 */ {"adjacent lines merge",
+              {{{4, 24}, {100, 16}}, {{4, 40}, {100, 16}}, {{4, 56}, {100, 16}}},
+              {{{4, 24}, {100, 48}}}},
+    /* 03 */ {"distant rects stay apart",
+              {{{0, 0}, {10, 10}}, {{100, 100}, {10, 10}}},
+              {{{0, 0}, {10, 10}}, {{100, 100}, {10, 10}}}},
+    /* 04 */ {"contained rect is absorbed",
+              {{{0, 0}, {100, 100}}, {{10, 10}, {5, 5}}}, {{{0, 0}, {100, 100}}}},
+    /* 05 */ {"bridge merges transitively",
+              {{{0, 0}, {10, 10}}, {{20, 0}, {10, 10}}, {{5, 0}, {20, 10}}},
+              {{{0, 0}, {30, 10}}}},
+  };
+
+  for (size_t i = 0; i < sizeof(tbl) / sizeof(tbl[0]); i++) {
+    printf("case %zd: %s\n", i, tbl[i].name);
+    DamageList damage;
+    for (const auto& r : tbl[i].input) {
+      damage.Add(r);
+    }
+    const auto& rects = damage.Rects();
+    bool ok = rects.size() == tbl[i].expected.size();
+    for (size_t j = 0; ok && j < rects.size(); j++) {
+      ok = RectEqual(rects[j], tbl[i].expected[j]);
+    }
+    if (!ok) {
+      printf("    \e[38;5;9mERR: got");
+      for (const auto& r : rects) { printf(" "); PrintRect(r); }
+      printf("\e[0m\n");
+      ret = -1;
+    }
+  }
+
+  printf("case %zd: too many rects collapse\n", sizeof(tbl) / sizeof(tbl[0]));
+  DamageList damage;
+  const int num_rects = DamageList::kMaxRects + 1;
+  for (int i = 0; i < num_rects; i++) {
+    damage.Add({{i * 20, i * 20}, {1, 1}});
+  }
+  const int end = (num_rects - 1) * 20 + 1;
+  const Rectangle<int> all{{0, 0}, {end, end}};
+  if (damage.Rects().size() != 1 || !RectEqual(damage.Rects()[0], all)) {
+    printf("    \e[38;5;9mERR: not collapsed\e[0m\n");
+    ret = -1;
+  }
+
+  struct {
+    const char* name;
+    Rectangle<int> a, b;
+    int expected_area;
+    size_t expected_num;
+  } sub_tbl[] = {
+    /* 00 */ {"disjoint", {{0, 0}, {10, 10}}, {{20, 20}, {5, 5}}, 100, 1},
+    /* 01 */ {"hole", {{0, 0}, {10, 10}}, {{2, 3}, {4, 5}}, 80, 4},
+    /* 02 */ {"fully covered", {{2, 2}, {4, 4}}, {{0, 0}, {10, 10}}, 0, 0},
+    /* 03 */ {"left edge", {{0, 0}, {10, 10}}, {{-5, 0}, {8, 10}}, 70, 1},
+  };
+  for (size_t i = 0; i < sizeof(sub_tbl) / sizeof(sub_tbl[0]); i++) {
+    const auto& t = sub_tbl[i];
+    printf("subtract case %zd: %s\n", i, t.name);
+    std::vector<Rectangle<int>> out;
+    SubtractRect(t.a, t.b, out);
+    int area = 0;
+    bool disjoint = true;
+    for (size_t j = 0; j < out.size(); j++) {
+      area += out[j].size.x * out[j].size.y;
+      const auto overlap_b = out[j] & t.b;
+      disjoint &= overlap_b.size.x <= 0 || overlap_b.size.y <= 0;
+      for (size_t k = j + 1; k < out.size(); k++) {
+        const auto overlap = out[j] & out[k];
+        disjoint &= overlap.size.x <= 0 || overlap.size.y <= 0;
+      }
+    }
+    if (out.size() != t.expected_num || area != t.expected_area || !disjoint) {
+      printf("    \e[38;5;9mERR: got %zu rects, area %d\e[0m\n", out.size(), area);
+      ret = -1;
+    }
+  }
+
+  return ret;
+}
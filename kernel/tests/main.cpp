@@ -1,5 +1,6 @@
 
 #include "tokenizer_test.hpp"
+#include "damage_test.hpp"
 
 int main() {
   int ret = 0;
@@ -7,6 +8,9 @@ int main() {
   printf("test: tokenizer\n");
   ret = ret | test_tokenize();
 
+  printf("test: damage\n");
+  ret = ret | test_damage();
+
   if (ret) {
     printf("\e[38;5;9mERR\e[0m\n");
   } else {
@@ -0,0 +1,152 @@
+// pixel_ops の各実装の画素処理速度を測る（make bench で実行）
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "../pixel_ops.hpp"
+
+namespace {
+  const int kWidth = 1920, kHeight = 1080, kRepeat = 50;
+
+  template <class Func>
+  void Measure(const char* name, Func f) {
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRepeat; ++i) {
+      f();
+    }
+    const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+    const double mpixels = static_cast<double>(kWidth) * kHeight * kRepeat / 1e6;
+    printf("  %-24s %8.1f Mpixel/s\n", name, mpixels / elapsed.count());
+  }
+
+  // 従来の PixelWriter::Write 相当（1 画素 3 バイトずつ書く）
+  void FillBytewise(uint8_t* dst, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      dst[4 * i + 0] = 0x12;
+      dst[4 * i + 1] = 0x34;
+      dst[4 * i + 2] = 0x56;
+    }
+  }
+}
+
+int main() {
+  std::vector<uint32_t> src(kWidth * kHeight, 0x123456), dst(kWidth * kHeight);
+  auto dst8 = reinterpret_cast<uint8_t*>(dst.data());
+  const size_t row_bytes = 4 * kWidth;
+
+  printf("baseline\n");
+  Measure("fill bytewise", [&] {
+    for (int y = 0; y < kHeight; ++y) {
+      FillBytewise(dst8 + row_bytes * y, kWidth);
+    }
+  });
+  Measure("copy memcpy", [&] {
+    for (int y = 0; y < kHeight; ++y) {
+      memcpy(&dst[kWidth * y], &src[kWidth * y], row_bytes);
+    }
+  });
+  Measure("move memmove", [&] {
+    for (int y = 0; y < kHeight; ++y) {
+      memmove(&dst[kWidth * y + 1], &dst[kWidth * y], row_bytes - 4);
+    }
+  });
+
+  const struct {
+    const char* name;
+    PixelOpsImpl impl;
+  } impls[] = {
+    {"sse2", PixelOpsImpl::kSSE2},
+    {"erms", PixelOpsImpl::kERMS},
+  };
+  for (const auto& impl : impls) {
+    printf("%s%s\n", impl.name,
+           impl.impl == DetectPixelOpsImpl() ? " (selected on this CPU)" : "");
+    SelectPixelOps(impl.impl);
+    Measure("FillPixels32", [&] {
+      for (int y = 0; y < kHeight; ++y) {
+        FillPixels32(&dst[kWidth * y], 0x123456, kWidth);
+      }
+    });
+    Measure("CopyPixels", [&] {
+      for (int y = 0; y < kHeight; ++y) {
+        CopyPixels(&dst[kWidth * y], &src[kWidth * y], row_bytes);
+      }
+    });
+  }
+
+  printf("common\n");
+  Measure("MovePixels (right)", [&] {
+    for (int y = 0; y < kHeight; ++y) {
+      MovePixels(&dst[kWidth * y + 1], &dst[kWidth * y], row_bytes - 4);
+    }
+  });
+  Measure("StreamPixels", [&] {
+    for (int y = 0; y < kHeight; ++y) {
+      StreamPixels(&dst[kWidth * y], &src[kWidth * y], row_bytes);
+    }
+    StreamFence();
+  });
+  std::vector<uint8_t> glyph_mask(kWidth / 8);
+  for (size_t i = 0; i < glyph_mask.size(); ++i) {
+    glyph_mask[i] = i * 0x5b; // フォントのように 0x00, 0xff 以外も混ざる
+  }
+  Measure("MaskFillPixels32", [&] {
+    for (int y = 0; y < kHeight; ++y) {
+      MaskFillPixels32(&dst[kWidth * y], glyph_mask.data(), 0, kWidth, 0x123456);
+    }
+  });
+  std::vector<uint32_t> translucent(kWidth * kHeight, 0x80123456);
+  Measure("BlendPixels", [&] {
+    for (int y = 0; y < kHeight; ++y) {
+      BlendPixels(&dst[kWidth * y], &translucent[kWidth * y], kWidth);
+    }
+  });
+
+  // 結果が正しいことを簡単に確認する
+  for (size_t skip = 0; skip < 16; ++skip) {
+    for (size_t count = 0; count < 40; ++count) {
+      uint32_t actual[40] = {}, expected[40] = {};
+      MaskFillPixels32(actual, glyph_mask.data() + 1, skip, count, 1);
+      for (size_t i = 0; i < count; ++i) {
+        const size_t bit = skip + i;
+        expected[i] = (glyph_mask[1 + bit / 8] & (0x80u >> (bit % 8))) ? 1 : 0;
+      }
+      if (memcmp(actual, expected, sizeof(actual)) != 0) {
+        printf("MaskFillPixels32 produced a wrong result: skip %zu, count %zu\n",
+               skip, count);
+        return 1;
+      }
+    }
+  }
+
+  const uint32_t blend_src[5] = {
+    0xff102030, 0x00102030, 0x80ffffff, 0x40000000, 0x80ffffff};
+  uint32_t blend_dst[5] = {
+    0x00aabbcc, 0x00aabbcc, 0x00000000, 0x00ffffff, 0x00000000};
+  const uint32_t blend_expected[5] = {
+    0xff102030, 0x00aabbcc, 0x40808080, 0x10bfbfbf, 0x40808080};
+  BlendPixels(blend_dst, blend_src, 5);
+  for (int i = 0; i < 5; ++i) {
+    if (blend_dst[i] != blend_expected[i]) {
+      printf("BlendPixels produced %08x at %d, expected %08x\n",
+             blend_dst[i], i, blend_expected[i]);
+      return 1;
+    }
+  }
+
+  MovePixels(&dst[1], &dst[0], row_bytes - 4);
+  for (int i = 0; i < kWidth; ++i) {
+    dst[i] = i;
+  }
+  MovePixels(&dst[3], &dst[0], row_bytes - 12);
+  for (int i = 3; i < kWidth; ++i) {
+    if (dst[i] != static_cast<uint32_t>(i - 3)) {
+      printf("MovePixels produced a wrong result at %d\n", i);
+      return 1;
+    }
+  }
+  return 0;
+}
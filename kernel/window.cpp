@@ -1,7 +1,12 @@
 #include "window.hpp"
 
+#include <algorithm>
+
 #include "logger.hpp"
 #include "font.hpp"
+#include "interrupt.hpp"
+#include "memory_manager.hpp"
+#include "pixel_ops.hpp"
 
 namespace {
   void DrawTextbox(PixelWriter& writer, Vector2D<int> pos, Vector2D<int> size,
@@ -44,11 +49,6 @@ namespace {
 }
 
 Window::Window(int width, int height, PixelFormat shadow_format) : width_{width}, height_{height} {
-  data_.resize(height);
-  for (int y = 0; y < height; ++y) {
-    data_[y].resize(width);
-  }
-
   FrameBufferConfig config{};
   config.frame_buffer = nullptr;
   config.horizontal_resolution = width;
@@ -61,7 +61,21 @@ Window::Window(int width, int height, PixelFormat shadow_format) : width_{width}
   }
 }
 
+Window::~Window() {
+  if (shared_buffer_) {
+    const FrameID frame{reinterpret_cast<uintptr_t>(shared_buffer_) / kBytesPerFrame};
+    memory_manager->Free(frame, num_shared_frames_);
+  }
+}
+
 void Window::DrawTo(FrameBuffer& dst, Vector2D<int> pos, const Rectangle<int>& area) {
+  if (AlphaBlend()) {
+    Rectangle<int> window_area{pos, Size()};
+    Rectangle<int> intersection = area & window_area;
+    dst.Blend(intersection.pos, shadow_buffer_, {intersection.pos - pos, intersection.size});
+    return;
+  }
+
   if (!transparent_color_) {
     Rectangle<int> window_area{pos, Size()};
     Rectangle<int> intersection = area & window_area;
@@ -69,17 +83,28 @@ void Window::DrawTo(FrameBuffer& dst, Vector2D<int> pos, const Rectangle<int>& a
     return;
   }
 
-  const auto tc = transparent_color_.value();
-  auto& writer = dst.Writer();
-  for (int y = std::max(0, 0 - pos.y);
-       y < std::min(Height(), writer.Height() - pos.y);
+  // アプリと共有している影バッファはいつ書き換わるか分からない
+  if (runs_dirty_ || shared_buffer_) {
+    UpdateOpaqueRuns();
+  }
+
+  const auto& dst_config = dst.Config();
+  const Rectangle<int> dst_area{
+    {0, 0},
+    {static_cast<int>(dst_config.horizontal_resolution),
+     static_cast<int>(dst_config.vertical_resolution)}};
+  const auto draw_area = area & dst_area & Rectangle<int>{pos, Size()};
+  const int x_begin = draw_area.pos.x - pos.x;
+  const int x_end = x_begin + draw_area.size.x;
+  for (int y = draw_area.pos.y - pos.y;
+       y < draw_area.pos.y + draw_area.size.y - pos.y;
        ++y) {
-    for (int x = std::max(0, 0 - pos.x);
-         x < std::min(Width(), writer.Width() - pos.x);
-         ++x) {
-      const auto c = At(Vector2D<int>{x, y});
-      if (c != tc) {
-        writer.Write(pos + Vector2D<int>{x, y}, c);
+    for (int i = run_index_[y]; i < run_index_[y + 1]; ++i) {
+      const int begin = std::max(opaque_runs_[i].begin, x_begin);
+      const int end = std::min(opaque_runs_[i].end, x_end);
+      if (begin < end) {
+        dst.Copy(pos + Vector2D<int>{begin, y}, shadow_buffer_,
+                 {{begin, y}, {end - begin, 1}});
       }
     }
   }
@@ -87,19 +112,145 @@ void Window::DrawTo(FrameBuffer& dst, Vector2D<int> pos, const Rectangle<int>& a
 
 void Window::SetTransparentColor(std::optional<PixelColor> c) {
   transparent_color_ = c;
+  runs_dirty_ = true;
+}
+
+void Window::SetAlphaBlend(bool enable) {
+  if (enable == AlphaBlend()) {
+    return;
+  }
+  alpha_bits_ = enable ? 0xff000000 : 0;
+  if (enable) {
+    for (int y = 0; y < height_; ++y) {
+      uint32_t* row = PixelAt({0, y});
+      for (int x = 0; x < width_; ++x) {
+        row[x] |= alpha_bits_;
+      }
+    }
+  }
+  runs_dirty_ = true;
+}
+
+void Window::UpdateOpaqueRuns() {
+  runs_dirty_ = false;
+  opaque_runs_.clear();
+  run_index_.resize(height_ + 1);
+  run_index_[0] = 0;
+
+  // 予約バイトは書き込み方によって値が異なるので比較から外す
+  const uint32_t kColorMask = 0x00ffffff;
+  const uint32_t tc = Pack(transparent_color_.value()) & kColorMask;
+  for (int y = 0; y < height_; ++y) {
+    const uint32_t* row = PixelAt({0, y});
+    int x = 0;
+    while (x < width_) {
+      while (x < width_ && (row[x] & kColorMask) == tc) {
+        ++x;
+      }
+      const int begin = x;
+      while (x < width_ && (row[x] & kColorMask) != tc) {
+        ++x;
+      }
+      if (begin < x) {
+        opaque_runs_.push_back({begin, x});
+      }
+    }
+    run_index_[y + 1] = opaque_runs_.size();
+  }
 }
 
 Window::WindowWriter* Window::Writer() {
   return &writer_;
 }
 
-const PixelColor& Window::At(Vector2D<int> pos) const{
-  return data_[pos.y][pos.x];
+PixelColor Window::At(Vector2D<int> pos) const {
+  const auto v = *PixelAt(pos);
+  if (shadow_buffer_.Config().pixel_format == kPixelRGBResv8BitPerColor) {
+    return RGBResv8BitPerColorPixelWriter::Unpack(v);
+  }
+  return BGRResv8BitPerColorPixelWriter::Unpack(v);
 }
 
 void Window::Write(Vector2D<int> pos, PixelColor c) {
-  data_[pos.y][pos.x] = c;
-  shadow_buffer_.Writer().Write(pos, c);
+  *PixelAt(pos) = Pack(c);
+  runs_dirty_ = true;
+}
+
+uint32_t* Window::PixelAt(Vector2D<int> pos) const {
+  const auto& config = shadow_buffer_.Config();
+  return reinterpret_cast<uint32_t*>(config.frame_buffer) +
+    config.pixels_per_scan_line * pos.y + pos.x;
+}
+
+uint32_t Window::Pack(const PixelColor& c) const {
+  if (shadow_buffer_.Config().pixel_format == kPixelRGBResv8BitPerColor) {
+    return RGBResv8BitPerColorPixelWriter::Pack(c) | alpha_bits_;
+  }
+  return BGRResv8BitPerColorPixelWriter::Pack(c) | alpha_bits_;
+}
+
+void Window::FillRect(Vector2D<int> pos, Vector2D<int> size, PixelColor c) {
+  const auto area = Rectangle<int>{pos, size} & Rectangle<int>{{0, 0}, Size()};
+  if (area.size.x <= 0) {
+    return;
+  }
+  if (AlphaBlend()) {
+    FillRectAlpha(area.pos, area.size, c, 255);
+    return;
+  }
+  shadow_buffer_.Writer().FillRect(area.pos, area.size, c);
+  runs_dirty_ = true;
+}
+
+void Window::FillRectAlpha(Vector2D<int> pos, Vector2D<int> size, PixelColor c,
+                           uint8_t alpha) {
+  const auto area = Rectangle<int>{pos, size} & Rectangle<int>{{0, 0}, Size()};
+  if (area.size.x <= 0) {
+    return;
+  }
+  const uint32_t value = (Pack(c) & 0x00ffffff) | uint32_t{alpha} << 24;
+  for (int y = area.pos.y; y < area.pos.y + area.size.y; ++y) {
+    FillPixels32(PixelAt({area.pos.x, y}), value, area.size.x);
+  }
+  runs_dirty_ = true;
+}
+
+void Window::WriteSpan(Vector2D<int> pos, const PixelColor* colors, int len) {
+  const auto area = Rectangle<int>{pos, {len, 1}} & Rectangle<int>{{0, 0}, Size()};
+  if (area.size.x <= 0 || area.size.y <= 0) {
+    return;
+  }
+  const auto src = colors + (area.pos.x - pos.x);
+  shadow_buffer_.Writer().WriteSpan(area.pos, src, area.size.x);
+  if (AlphaBlend()) {
+    uint32_t* p = PixelAt(area.pos);
+    for (int i = 0; i < area.size.x; ++i) {
+      p[i] |= alpha_bits_;
+    }
+  }
+  runs_dirty_ = true;
+}
+
+void Window::WriteMaskSpan(Vector2D<int> pos, const uint8_t* mask, int len,
+                           PixelColor c) {
+  runs_dirty_ = true;
+  if (!AlphaBlend()) {
+    shadow_buffer_.Writer().WriteMaskSpan(pos, mask, len, c);
+    return;
+  }
+
+  const auto area = Rectangle<int>{pos, {len, 1}} & Rectangle<int>{{0, 0}, Size()};
+  if (area.size.x <= 0 || area.size.y <= 0) {
+    return;
+  }
+  const uint32_t value = Pack(c);
+  uint32_t* row = PixelAt({0, pos.y});
+  for (int x = area.pos.x; x < area.pos.x + area.size.x; ++x) {
+    const int bit = x - pos.x;
+    if (mask[bit >> 3] & (0x80u >> (bit & 7))) {
+      row[x] = value;
+    }
+  }
 }
 
 int Window::Width() const {
@@ -116,6 +267,55 @@ Vector2D<int> Window::Size() const {
 
 void Window::Move(Vector2D<int> dst_pos, const Rectangle<int>& src) {
   shadow_buffer_.Move(dst_pos, src);
+  runs_dirty_ = true;
+}
+
+WithError<uint8_t*> Window::ShareShadowBuffer() {
+  if (shared_buffer_) {
+    return { shared_buffer_, MAKE_ERROR(Error::kSuccess) };
+  }
+
+  // 影バッファは 1 画素 4 バイトで，ライン長は揃えた後の pixels_per_scan_line 画素分
+  auto config = shadow_buffer_.Config();
+  const size_t bytes = 4 * config.pixels_per_scan_line * config.vertical_resolution;
+  const size_t num_frames = (bytes + kBytesPerFrame - 1) / kBytesPerFrame;
+  auto [ frame, err ] = memory_manager->Allocate(num_frames);
+  if (err) {
+    return { nullptr, err };
+  }
+
+  // 合成タスクや他のスレッドが古いバッファを読み書きしている途中で差し替えないよう，
+  // 写しと差し替えは割り込みを禁止して行う
+  auto buf = reinterpret_cast<uint8_t*>(frame.Frame());
+  const bool interrupts_enabled = DisableInterrupts();
+  if (shared_buffer_) {
+    if (interrupts_enabled) {
+      __asm__("sti");
+    }
+    memory_manager->Free(frame, num_frames);
+    return { shared_buffer_, MAKE_ERROR(Error::kSuccess) };
+  }
+  memcpy(buf, config.frame_buffer, bytes);
+  memset(buf + bytes, 0, num_frames * kBytesPerFrame - bytes);
+  config.frame_buffer = buf;
+  auto init_err = shadow_buffer_.Initialize(config);
+  if (!init_err) {
+    shared_buffer_ = buf;
+    num_shared_frames_ = num_frames;
+  }
+  if (interrupts_enabled) {
+    __asm__("sti");
+  }
+
+  if (init_err) {
+    memory_manager->Free(frame, num_frames);
+    return { nullptr, init_err };
+  }
+  return { shared_buffer_, MAKE_ERROR(Error::kSuccess) };
+}
+
+const FrameBufferConfig& Window::ShadowConfig() const {
+  return shadow_buffer_.Config();
 }
 
 WindowRegion Window::GetWindowRegion(Vector2D<int> pos) {
@@ -38,6 +38,23 @@ class Window {
     virtual int Width() const override { return window_.Width(); }
     /** @brief Height は関連付けられた Window の高さをピクセル単位で返す。 */
     virtual int Height() const override { return window_.Height(); }
+    /** @brief 矩形を塗りつぶす */
+    virtual void FillRect(const Vector2D<int>& pos, const Vector2D<int>& size,
+                          const PixelColor& c) override {
+      window_.FillRect(pos, size, c);
+    }
+    virtual void FillSpan(Vector2D<int> pos, int len,
+                          const PixelColor& c) override {
+      window_.FillRect(pos, {len, 1}, c);
+    }
+    virtual void WriteSpan(Vector2D<int> pos, const PixelColor* colors,
+                           int len) override {
+      window_.WriteSpan(pos, colors, len);
+    }
+    virtual void WriteMaskSpan(Vector2D<int> pos, const uint8_t* mask, int len,
+                               const PixelColor& c) override {
+      window_.WriteMaskSpan(pos, mask, len, c);
+    }
 
    private:
     Window& window_;
@@ -45,7 +62,7 @@ class Window {
 
   /** @brief 指定されたピクセル数の平面描画領域を作成する。 */
   Window(int width, int height, PixelFormat shadow_format);
-  virtual ~Window() = default;
+  virtual ~Window();
   Window(const Window& rhs) = delete;
   Window& operator=(const Window& rhs) = delete;
 
@@ -58,13 +75,31 @@ class Window {
   void DrawTo(FrameBuffer& dst, Vector2D<int> pos, const Rectangle<int>& area);
   /** @brief 透過色を設定する。 */
   void SetTransparentColor(std::optional<PixelColor> c);
+  /** @brief 画素ごとの不透明度による合成を有効・無効にする。
+   *
+   * 有効にすると，影バッファの各画素の最上位バイトを不透明度（255 で不透明）として
+   * 下のレイヤーに合成する。有効にした時点の画素はすべて不透明になる。
+   * PixelColor を受け取る描画関数は不透明な画素を書く。透過色の設定は無視される。
+   */
+  void SetAlphaBlend(bool enable);
+  bool AlphaBlend() const { return alpha_bits_ != 0; }
+  /** @brief 透過色も合成も無く，描画範囲を完全に覆うなら true を返す。 */
+  bool IsOpaque() const { return !transparent_color_ && !AlphaBlend(); }
   /** @brief このインスタンスに紐付いた WindowWriter を取得する。 */
   WindowWriter* Writer();
 
   /** @brief 指定した位置のピクセルを返す。 */
-  const PixelColor& At(Vector2D<int> pos) const;
+  PixelColor At(Vector2D<int> pos) const;
   /** @brief 指定した位置にピクセルを書き込む。 */
   void Write(Vector2D<int> pos, PixelColor c);
+  /** @brief 指定した矩形を塗りつぶす。ウィンドウからはみ出す部分は無視する。 */
+  void FillRect(Vector2D<int> pos, Vector2D<int> size, PixelColor c);
+  /** @brief pos から右へ colors[0..len) を書き込む。はみ出す部分は無視する。 */
+  void WriteSpan(Vector2D<int> pos, const PixelColor* colors, int len);
+  /** @brief pos から右へ len 画素のうち，mask のビットが 1 の画素を c にする。 */
+  void WriteMaskSpan(Vector2D<int> pos, const uint8_t* mask, int len, PixelColor c);
+  /** @brief 指定した矩形を不透明度 alpha の色 c で塗りつぶす。合成が有効なときだけ意味を持つ。 */
+  void FillRectAlpha(Vector2D<int> pos, Vector2D<int> size, PixelColor c, uint8_t alpha);
 
   /** @brief 平面描画領域の横幅をピクセル単位で返す。 */
   int Width() const;
@@ -81,17 +116,43 @@ class Window {
    */
   void Move(Vector2D<int> dst_pos, const Rectangle<int>& src);
 
+  /** @brief 影バッファをアプリと共有できる連続した物理フレームへ移し，その先頭を返す。
+   *
+   * 内容は引き継ぐ。2 回目以降は同じ領域を返す。領域はウィンドウの破棄時に解放する。
+   */
+  WithError<uint8_t*> ShareShadowBuffer();
+  /** @brief 影バッファの設定を返す。 */
+  const FrameBufferConfig& ShadowConfig() const;
+
   virtual void Activate() {}
   virtual void Deactivate() {}
   virtual WindowRegion GetWindowRegion(Vector2D<int> pos);
 
  private:
   int width_, height_;
-  std::vector<std::vector<PixelColor>> data_{};
   WindowWriter writer_{*this};
   std::optional<PixelColor> transparent_color_{std::nullopt};
 
+  /** @brief ウィンドウの画素を画面と同じ形式で保持する唯一の描画領域 */
   FrameBuffer shadow_buffer_{};
+  uint8_t* shared_buffer_{nullptr};
+  size_t num_shared_frames_{0};
+  /** @brief 合成が有効なら 0xff000000。PixelColor から作る画素に付ける不透明度 */
+  uint32_t alpha_bits_{0};
+
+  /** @brief 透過色でない画素が連続する区間 [begin, end) */
+  struct OpaqueRun {
+    int begin, end;
+  };
+  /** @brief 全行の不透明区間。y 行目の区間は opaque_runs_[run_index_[y]..run_index_[y + 1]) */
+  std::vector<OpaqueRun> opaque_runs_{};
+  std::vector<int> run_index_{};
+  /** @brief 画素か透過色が変わり，opaque_runs_ を作り直す必要がある */
+  bool runs_dirty_{true};
+
+  uint32_t* PixelAt(Vector2D<int> pos) const;
+  uint32_t Pack(const PixelColor& c) const;
+  void UpdateOpaqueRuns();
 };
 
 class ToplevelWindow : public Window {
@@ -111,6 +172,22 @@ class ToplevelWindow : public Window {
       return window_.Width() - kTopLeftMargin.x - kBottomRightMargin.x; }
     virtual int Height() const override {
       return window_.Height() - kTopLeftMargin.y - kBottomRightMargin.y; }
+    virtual void FillRect(const Vector2D<int>& pos, const Vector2D<int>& size,
+                          const PixelColor& c) override {
+      window_.FillRect(pos + kTopLeftMargin, size, c);
+    }
+    virtual void FillSpan(Vector2D<int> pos, int len,
+                          const PixelColor& c) override {
+      window_.FillRect(pos + kTopLeftMargin, {len, 1}, c);
+    }
+    virtual void WriteSpan(Vector2D<int> pos, const PixelColor* colors,
+                           int len) override {
+      window_.WriteSpan(pos + kTopLeftMargin, colors, len);
+    }
+    virtual void WriteMaskSpan(Vector2D<int> pos, const uint8_t* mask, int len,
+                               const PixelColor& c) override {
+      window_.WriteMaskSpan(pos + kTopLeftMargin, mask, len, c);
+    }
 
    private:
     ToplevelWindow& window_;